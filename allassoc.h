@@ -0,0 +1,208 @@
+/*
+ * allassoc.h: implements all-associativity simulation (Hill and Smith).  One
+ *             pass over the trace gives the miss rate of a LRU cache for every
+ *             power of 2 number of sets and associativity at once.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#define ALLASSOC_LEVELS 32          // most set counts (1, 2, 4, ...) looked at
+#define ALLASSOC_NIL    (~0u)       // end of the LRU stack
+
+/*
+ * struct allassoc_node: implements a block in the LRU stack.
+ */
+struct allassoc_node {
+    addr_t block;
+    uint_t prev;
+    uint_t next;
+};
+
+/*
+ * struct allassoc: holds the all-associativity simulation of one stream of references.
+ *
+ * NOTE: there is a single LRU stack of every block seen so far.  With 2^s sets a
+ * block goes in the set given by the low s bits of its block number, so a block y
+ * shares x's set for every s up to the number of trailing zeros of x ^ y.  Walking
+ * down the stack from the top to x and counting, for each s, the blocks that
+ * share x's set gives the stack distance of x within its set, and so whether it
+ * hits, for every number of sets at once.  The walk stops early once x would miss
+ * in every cache no bigger than max_blocks.
+ */
+struct allassoc {
+    uint_t block_size;
+    uint_t max_blocks;          // biggest cache looked at, in blocks
+    uint_t levels;              // set counts 1 to 2^(levels-1)
+
+    // the LRU stack, as a list through nodes (head is most recently used)
+    struct allassoc_node *node;
+    uint_t nodes;
+    uint_t room;
+    uint_t head;
+
+    // node of each block, in an open addressing hash table (node + 1, 0 if empty)
+    uint_t *table;
+    uint_t table_mask;
+
+    // hist[s][d] counts references at distance d within their set with 2^s sets
+    ulong_t *hist[ALLASSOC_LEVELS];
+    ulong_t refs;
+};
+
+/*
+ * allassoc_init: sets up the simulation of caches of up to max_size bytes in
+ * blocks of block_size bytes.
+ */
+void allassoc_init(struct allassoc *aa, uint_t block_size, uint_t max_size)
+{
+    uint_t s;
+
+    aa->block_size = block_size;
+    aa->max_blocks = max_size / block_size;
+    if (aa->max_blocks == 0)
+        aa->max_blocks = 1;
+    for (aa->levels=1; aa->levels<ALLASSOC_LEVELS && (2u << (aa->levels - 1)) <= aa->max_blocks; aa->levels++)
+        ;
+
+    // with 2^s sets, at most max_blocks >> s ways fit
+    for (s=0; s<aa->levels; s++)
+        aa->hist[s] = (ulong_t *) ec_malloc((aa->max_blocks >> s) * sizeof(ulong_t));
+
+    aa->room = 1024;
+    aa->node = (struct allassoc_node *) ec_malloc(aa->room * sizeof(struct allassoc_node));
+    aa->nodes = 0;
+    aa->head = ALLASSOC_NIL;
+    aa->table_mask = 2 * aa->room - 1;
+    aa->table = (uint_t *) ec_malloc((aa->table_mask + 1) * sizeof(uint_t));
+    aa->refs = 0;
+}
+
+/*
+ * allassoc_free: frees what allassoc_init allocated.
+ */
+void allassoc_free(struct allassoc *aa)
+{
+    uint_t s;
+
+    for (s=0; s<aa->levels; s++)
+        free(aa->hist[s]);
+    free(aa->node);
+    free(aa->table);
+}
+
+/*
+ * allassoc_slot: finds the slot of a block in the table, or the empty slot where
+ * it belongs.
+ */
+static inline uint_t * allassoc_slot(struct allassoc *aa, addr_t block)
+{
+    uint_t h = addr_fold(block) * 0x9e3779b1u, j;
+
+    for (j=(h ^ (h >> 16)) & aa->table_mask; aa->table[j]; j=(j+1) & aa->table_mask)
+        if (aa->node[aa->table[j] - 1].block == block)
+            break;
+    return &aa->table[j];
+}
+
+/*
+ * allassoc_grow: doubles the room for nodes, and the table with it.
+ */
+void allassoc_grow(struct allassoc *aa)
+{
+    uint_t j;
+
+    aa->room *= 2;
+    aa->node = (struct allassoc_node *) realloc(aa->node, aa->room * sizeof(struct allassoc_node));
+    if (aa->node == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    free(aa->table);
+    aa->table_mask = 2 * aa->room - 1;
+    aa->table = (uint_t *) ec_malloc((aa->table_mask + 1) * sizeof(uint_t));
+    for (j=0; j<aa->nodes; j++)
+        *allassoc_slot(aa, aa->node[j].block) = j + 1;
+}
+
+/*
+ * allassoc_ref: records a reference to addr.
+ */
+void allassoc_ref(struct allassoc *aa, addr_t addr)
+{
+    addr_t x = addr / aa->block_size;
+    uint_t *slot = allassoc_slot(aa, x);
+    uint_t count[ALLASSOC_LEVELS];
+    uint_t n, y, s, c, open;
+
+    aa->refs++;
+
+    if (*slot == 0) {   // never seen, a miss everywhere
+        if (aa->nodes == aa->room) {
+            allassoc_grow(aa);
+            slot = allassoc_slot(aa, x);
+        }
+        n = aa->nodes++;
+        *slot = n + 1;
+        aa->node[n].block = x;
+    } else {
+        n = *slot - 1;
+
+        // count the blocks above x that share its set, until it misses everywhere
+        memset(count, 0, aa->levels * sizeof(uint_t));
+        open = aa->levels;
+        for (y=aa->head; y!=n && open; y=aa->node[y].next) {
+            c = __builtin_ctzll(aa->node[y].block ^ x);
+            for (s=0; s<=c && s<aa->levels; s++)
+                if (++count[s] == (aa->max_blocks >> s))
+                    open--;
+        }
+        if (y == n)
+            for (s=0; s<aa->levels; s++)
+                if (count[s] < (aa->max_blocks >> s))
+                    aa->hist[s][count[s]]++;
+
+        // unlink x to move it to the top
+        if (n == aa->head)
+            return;
+        aa->node[aa->node[n].prev].next = aa->node[n].next;
+        if (aa->node[n].next != ALLASSOC_NIL)
+            aa->node[aa->node[n].next].prev = aa->node[n].prev;
+    }
+
+    aa->node[n].next = aa->head;
+    if (aa->head != ALLASSOC_NIL)
+        aa->node[aa->head].prev = n;
+    aa->head = n;
+}
+
+/*
+ * allassoc_report: prints the miss rate for every number of sets and associativity
+ * (each a power of 2) of caches up to max_blocks.
+ */
+void allassoc_report(struct allassoc *aa, const char *name)
+{
+    ulong_t hits;
+    uint_t s, a, d;
+
+    printf("\
+Memory Level: %s\n\
+\tReferences = %Lu\tBlocks = %u\n\
+\tMiss rates by number of sets (down) and ways (across):\n\
+\t%8s", name, aa->refs, aa->nodes, "");
+    for (a=1; a<=aa->max_blocks; a*=2)
+        printf(" %7u", a);
+    printf("\n");
+
+    for (s=0; s<aa->levels; s++) {
+        printf("\t%8u", 1u << s);
+        hits = 0;
+        for (a=1, d=0; a<=(aa->max_blocks >> s); a*=2) {
+            for (; d<a; d++)
+                hits += aa->hist[s][d];
+            printf(" %6.2f%%", aa->refs ? (double) (aa->refs - hits) / aa->refs * 100 : 0.0);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
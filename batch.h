@@ -0,0 +1,380 @@
+/*
+ * batch.h: implements reading the trace a batch of records at a time.  Text
+ *          traces are decoded with SIMD kernels where the processor has them;
+ *          the kernel is picked at runtime from the CPU's features.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86
+#include <immintrin.h>
+#endif
+
+#define TRACE_BATCH     4096        // records per batch
+#define BATCH_WINDOW    32          // bytes a kernel looks at per line
+#define TRACE_QUANTUM   16          // records a core runs per turn in a merged trace
+
+/*
+ * struct trace_batch: holds a batch of decoded trace records, one array per field.
+ * core is the core that ran each record, which is always 0 unless the trace is
+ * merged from the traces of several cores.
+ */
+struct trace_batch {
+    uint_t n;
+    unsigned char core[TRACE_BATCH];
+    char op[TRACE_BATCH];
+    addr_t op_addr[TRACE_BATCH];
+    addr_t byte_addr[TRACE_BATCH];
+};
+
+/*
+ * A batch kernel decodes whole text lines from t->pos into b starting at record
+ * n, and returns how many records b holds afterwards.  It stops at the first
+ * line it isn't sure about, leaving that one to trace_next().
+ */
+typedef uint_t (*batch_kernel)(struct trace *t, struct trace_batch *b, uint_t n);
+
+static batch_kernel batch_decode = NULL;
+
+/*
+ * batch_scalar: leaves every line to trace_next().
+ */
+uint_t batch_scalar(struct trace *t, struct trace_batch *b, uint_t n)
+{
+    return n;
+}
+
+#ifdef BATCH_X86
+/*
+ * batch_line: finds the fields of the line at the start of a kernel's window
+ * from the bitmasks of its whitespace (ws), hex digit (hex) and newline (nl)
+ * bytes.  Only "op addr addr" lines with 1 to ADDR_DIGITS digit fields, which
+ * trace_next() would read the same way, are accepted.  Lines longer than the
+ * window, as 64 bit addresses written out in full make them, are left to
+ * trace_next().
+ *
+ * returns the length of the line including its newline, or 0 to give up on it
+ */
+static inline int batch_line(uint_t ws, uint_t hex, uint_t nl, int *s1, int *e1, int *s2, int *e2)
+{
+    int eol;
+    uint_t m;
+
+    if (nl == 0 || (ws & 1))
+        return 0;
+    eol = __builtin_ctz(nl);
+
+    // op_addr: the digits after the op
+    if ((m = ~ws & ~1u) == 0 || (*s1 = __builtin_ctz(m)) >= eol)
+        return 0;
+    if ((m = ~hex & (~0u << *s1)) == 0)
+        return 0;
+    *e1 = __builtin_ctz(m);
+
+    // byte_addr: more digits after some whitespace on the same line
+    if ((m = ~ws & (~0u << *e1)) == 0 || (*s2 = __builtin_ctz(m)) >= eol || *s2 == *e1)
+        return 0;
+    if ((m = ~hex & (~0u << *s2)) == 0)
+        return 0;
+    *e2 = __builtin_ctz(m);
+
+    if (*e1 == *s1 || *e1 - *s1 > ADDR_DIGITS || *e2 == *s2 || *e2 - *s2 > ADDR_DIGITS)
+        return 0;
+
+    // nothing but whitespace may follow
+    if (~ws & (~0u << *e2) & ((1u << eol) - 1))
+        return 0;
+    return eol + 1;
+}
+
+/*
+ * batch_hex: decodes the len (1 to 8) hex digits ending just before end, eight
+ * at a time in a 64 bit word.  The 8 bytes before end must be readable.
+ */
+static inline uint_t batch_hex(const char *end, int len)
+{
+    ulong_t x, keep = ~0ULL << (8 * (8 - len));
+
+    memcpy(&x, end - 8, 8);
+    x = (x & keep) | (0x3030303030303030ULL & ~keep);     // pad with '0's
+    x = (x & 0x0f0f0f0f0f0f0f0fULL) + ((x >> 6) & 0x0101010101010101ULL) * 9;
+    x = ((x & 0x0f000f000f000f00ULL) >> 8) | ((x & 0x000f000f000f000fULL) << 4);
+    x = ((x & 0x00ff000000ff0000ULL) >> 16) | ((x & 0x000000ff000000ffULL) << 8);
+    return (uint_t) (((x & 0xffff) << 16) | ((x >> 32) & 0xffff));
+}
+
+/*
+ * batch_addr: decodes the len (1 to ADDR_DIGITS) hex digits ending just before
+ * end.  The ADDR_DIGITS bytes before end must be readable.
+ */
+static inline addr_t batch_addr(const char *end, int len)
+{
+#ifdef ADDR64
+    if (len > 8)
+        return (addr_t) batch_hex(end - 8, len - 8) << 32 | batch_hex(end, 8);
+#endif
+    return batch_hex(end, len);
+}
+
+/*
+ * batch_sse2: classifies each line's bytes 16 at a time with SSE2 and decodes the
+ * fields with batch_addr().
+ */
+uint_t batch_sse2(struct trace *t, struct trace_batch *b, uint_t n)
+{
+    const char *p = t->pos;
+    const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8('9');
+    const __m128i a = _mm_set1_epi8('a'), f = _mm_set1_epi8('f');
+    const __m128i tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r');
+    const __m128i sp = _mm_set1_epi8(' '), lf = _mm_set1_epi8('\n'), bit5 = _mm_set1_epi8(0x20);
+    __m128i v, lc, hex, ws;
+    uint_t mws, mhex, mnl;
+    int s1, e1, s2, e2, len, j;
+
+    while (n < TRACE_BATCH && t->end - p >= BATCH_WINDOW) {
+        mws = mhex = mnl = 0;
+        for (j=0; j<2; j++) {
+            v = _mm_loadu_si128((const __m128i *) (p + 16 * j));
+            lc = _mm_or_si128(v, bit5);
+            hex = _mm_or_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, zero), v), _mm_cmpeq_epi8(_mm_min_epu8(v, nine), v)),
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(lc, a), lc), _mm_cmpeq_epi8(_mm_min_epu8(lc, f), lc)));
+            ws = _mm_or_si128(_mm_cmpeq_epi8(v, sp),
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, tab), v), _mm_cmpeq_epi8(_mm_min_epu8(v, cr), v)));
+            mws |= (uint_t) _mm_movemask_epi8(ws) << (16 * j);
+            mhex |= (uint_t) _mm_movemask_epi8(hex) << (16 * j);
+            mnl |= (uint_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf)) << (16 * j);
+        }
+
+        if ((len = batch_line(mws, mhex, mnl, &s1, &e1, &s2, &e2)) == 0
+                || (p - t->buf) + e1 < ADDR_DIGITS)
+            break;
+
+        b->op[n] = p[0];
+        b->op_addr[n] = batch_addr(p + e1, e1 - s1);
+        b->byte_addr[n] = batch_addr(p + e2, e2 - s2);
+        n++;
+        p += len;
+    }
+
+    t->pos = (char *) p;
+    return n;
+}
+
+/*
+ * batch_avx2: classifies a whole line's bytes in one go with AVX2 and decodes
+ * both of its fields together in one vector, if they are no more than 8 digits.
+ */
+__attribute__((target("avx2")))
+uint_t batch_avx2(struct trace *t, struct trace_batch *b, uint_t n)
+{
+    const char *p = t->pos;
+    const __m256i zero = _mm256_set1_epi8('0'), nine = _mm256_set1_epi8('9');
+    const __m256i a = _mm256_set1_epi8('a'), f = _mm256_set1_epi8('f');
+    const __m256i tab = _mm256_set1_epi8('\t'), cr = _mm256_set1_epi8('\r');
+    const __m256i sp = _mm256_set1_epi8(' '), lf = _mm256_set1_epi8('\n'), bit5 = _mm256_set1_epi8(0x20);
+    const __m128i pad = _mm_set1_epi8('0'), low = _mm_set1_epi8(0x0f), one = _mm_set1_epi8(0x01);
+    const __m128i by16 = _mm_set1_epi16(0x0110), by256 = _mm_set1_epi32(0x00010100);
+    __m256i v, lc, hex, ws;
+    __m128i x, keep, alpha;
+    ulong_t f1, f2;
+    int s1, e1, s2, e2, len;
+
+    while (n < TRACE_BATCH && t->end - p >= BATCH_WINDOW) {
+        v = _mm256_loadu_si256((const __m256i *) p);
+        lc = _mm256_or_si256(v, bit5);
+        hex = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, zero), v), _mm256_cmpeq_epi8(_mm256_min_epu8(v, nine), v)),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(lc, a), lc), _mm256_cmpeq_epi8(_mm256_min_epu8(lc, f), lc)));
+        ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, tab), v), _mm256_cmpeq_epi8(_mm256_min_epu8(v, cr), v)));
+
+        if ((len = batch_line(_mm256_movemask_epi8(ws), _mm256_movemask_epi8(hex),
+                        _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf)), &s1, &e1, &s2, &e2)) == 0
+                || (p - t->buf) + e1 < ADDR_DIGITS)
+            break;
+#ifdef ADDR64
+        if (e1 - s1 > 8 || e2 - s2 > 8) {
+            b->op[n] = p[0];
+            b->op_addr[n] = batch_addr(p + e1, e1 - s1);
+            b->byte_addr[n] = batch_addr(p + e2, e2 - s2);
+            n++;
+            p += len;
+            continue;
+        }
+#endif
+
+        // both fields right aligned in their own half, padded with '0's
+        memcpy(&f1, p + e1 - 8, 8);
+        memcpy(&f2, p + e2 - 8, 8);
+        x = _mm_set_epi64x(f2, f1);
+        keep = _mm_set_epi64x(~0ULL << (8 * (8 - (e2 - s2))), ~0ULL << (8 * (8 - (e1 - s1))));
+        x = _mm_or_si128(_mm_and_si128(x, keep), _mm_andnot_si128(keep, pad));
+
+        // ascii to nibbles, then nibbles to bytes, bytes to 16 bit halves, halves to words
+        alpha = _mm_and_si128(_mm_srli_epi16(x, 6), one);
+        x = _mm_add_epi8(_mm_and_si128(x, low), _mm_add_epi8(_mm_slli_epi16(alpha, 3), alpha));
+        x = _mm_madd_epi16(_mm_maddubs_epi16(x, by16), by256);
+        x = _mm_or_si128(_mm_slli_epi64(x, 16), _mm_srli_epi64(x, 32));
+
+        b->op[n] = p[0];
+        b->op_addr[n] = (uint_t) _mm_cvtsi128_si32(x);
+        b->byte_addr[n] = (uint_t) _mm_extract_epi32(x, 2);
+        n++;
+        p += len;
+    }
+
+    t->pos = (char *) p;
+    return n;
+}
+#endif
+
+/*
+ * batch_select: picks the best kernel this processor can run.  Setting
+ * CACHESIM_SIMD to scalar, sse2 or avx2 overrides the choice.
+ */
+batch_kernel batch_select()
+{
+    const char *want = getenv("CACHESIM_SIMD");
+
+    if (want && !strcmp(want, "scalar"))
+        return batch_scalar;
+#ifdef BATCH_X86
+    __builtin_cpu_init();
+    if ((!want || !strcmp(want, "avx2")) && __builtin_cpu_supports("avx2"))
+        return batch_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return batch_sse2;
+#endif
+    return batch_scalar;
+}
+
+uint_t trace_merge_batch(struct trace *, struct trace_batch *);
+
+/*
+ * trace_read_batch: fills b with as many records from the trace as it can hold.
+ *
+ * returns the number of records read, which is less than TRACE_BATCH only at the
+ * end of the trace
+ */
+uint_t trace_read_batch(struct trace *t, struct trace_batch *b)
+{
+    uint_t n = 0, k;
+
+    if (t->merge != NULL)
+        return trace_merge_batch(t, b);
+    if (batch_decode == NULL)
+        batch_decode = batch_select();
+
+    while (n < TRACE_BATCH) {
+        if (!t->eof && t->end - t->pos < TRACE_MAXLINE)
+            trace_refill(t);
+        if (t->encoding == TRACE_TEXT && (k = batch_decode(t, b, n)) > n) {
+            n = k;
+            continue;
+        }
+        if (!trace_next(t, &b->op[n], &b->op_addr[n], &b->byte_addr[n]))
+            break;
+        n++;
+    }
+
+    memset(b->core, 0, n);
+    b->n = n;
+    return n;
+}
+
+/*
+ * trace_merge_out: returns 1 if core c's trace has run out.
+ */
+static inline int trace_merge_out(struct trace_merge *m, uint_t c)
+{
+    return m->used[c] == m->batch[c].n && m->batch[c].n < TRACE_BATCH;
+}
+
+/*
+ * trace_merge_pass: hands the turn on to the next core with records left.
+ */
+static inline void trace_merge_pass(struct trace_merge *m)
+{
+    uint_t c = m->turn;
+
+    if (m->live == 0)
+        return;
+    do
+        c = (c + 1) % m->cores;
+    while (trace_merge_out(m, c));
+    m->turn = c;
+    m->left = m->quantum;
+}
+
+/*
+ * trace_merge: prepares t to read the n traces on fds, one for each core, as a
+ * single trace, the cores taking turns quantum records at a time.
+ */
+void trace_merge(struct trace *t, const int *fds, uint_t n, uint_t quantum)
+{
+    struct trace_merge *m = (struct trace_merge *) ec_malloc(sizeof(struct trace_merge));
+    uint_t c;
+
+    memset(t, 0, sizeof(struct trace));
+    t->merge = m;
+    m->trace = (struct trace *) ec_malloc(n * sizeof(struct trace));
+    m->batch = (struct trace_batch *) ec_malloc(n * sizeof(struct trace_batch));
+    m->used = (uint_t *) ec_malloc(n * sizeof(uint_t));
+    m->cores = m->live = n;
+    m->quantum = quantum;
+
+    for (c=0; c<n; c++) {
+        trace_open(&m->trace[c], fds[c]);
+        if (trace_read_batch(&m->trace[c], &m->batch[c]) == 0)
+            m->live--;
+    }
+    m->turn = n - 1;
+    trace_merge_pass(m);
+}
+
+/*
+ * trace_merge_batch: fills b with the next records of a merged trace, as
+ * trace_read_batch does.
+ */
+uint_t trace_merge_batch(struct trace *t, struct trace_batch *b)
+{
+    struct trace_merge *m = t->merge;
+    struct trace_batch *p;
+    uint_t n = 0, k, c, j;
+
+    while (n < TRACE_BATCH && m->live > 0) {
+        c = m->turn;
+        p = &m->batch[c];
+        if (m->used[c] == p->n) {       // on to the core's next batch
+            trace_read_batch(&m->trace[c], p);
+            m->used[c] = 0;
+        }
+
+        // as much of the turn as the core's batch and b have room for
+        k = p->n - m->used[c];
+        if (k > m->left)
+            k = m->left;
+        if (k > TRACE_BATCH - n)
+            k = TRACE_BATCH - n;
+        j = m->used[c];
+        memset(b->core + n, c, k);
+        memcpy(b->op + n, p->op + j, k);
+        memcpy(b->op_addr + n, p->op_addr + j, k * sizeof(addr_t));
+        memcpy(b->byte_addr + n, p->byte_addr + j, k * sizeof(addr_t));
+        m->used[c] += k;
+        m->left -= k;
+        n += k;
+
+        if (trace_merge_out(m, c)) {
+            m->live--;
+            m->left = 0;
+        }
+        if (m->left == 0)
+            trace_merge_pass(m);
+    }
+
+    b->n = n;
+    return n;
+}
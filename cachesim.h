@@ -0,0 +1,584 @@
+/*
+ * cachesim.h: implements a memory hierarchy (any number of levels of cache, each
+ *             split or unified, over main memory, with L1s of its own for each
+ *             of one or more cores) as an object that owns all of its state, so
+ *             any number of simulations can run side by side in one process.
+ *             Everything is in this header; include it in one source file.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#include <math.h>
+#include <libconfig.h>
+#include "mycache.h"
+#include "policy.h"
+#include "engine.h"
+#include "coherence.h"
+
+#define lg(x) ((uint_t) (log(x) / log(2)))
+
+/*
+ * struct cachesim_core: holds what belongs to one core: its L1 caches and the
+ * instructions it ran.
+ */
+struct cachesim_core {
+    struct cache l1[2];         // like level 0 of the hierarchy, split or just l1[0]
+    cache_level l1i, l1d;       // where its instructions and data come in
+
+    // instruction counts
+    ulong_t num_load;
+    ulong_t num_store;
+    ulong_t num_branch;
+    ulong_t num_comp;
+
+    // cycles spent on each kind of instruction
+    ulong_t load_cycles;
+    ulong_t store_cycles;
+    ulong_t branch_cycles;
+    ulong_t comp_cycles;
+};
+
+/*
+ * struct cachesim: holds one simulated memory hierarchy and its statistics.
+ *
+ * NOTE: a simulation goes cachesim_init, cachesim_config for each settings file,
+ * cachesim_start, cachesim_simulate for each trace record, then cachesim_report
+ * and cachesim_end.
+ *
+ * Level j of cache (L1 is level 0) is split into cache[j][0] for instructions
+ * and cache[j][1] for data if split[j] is set, or is just cache[j][0] otherwise.
+ * Each cache's next is the cache below it on the same side, or main memory under
+ * the last level.  A split level can't be under a unified one.  Every core has
+ * L1s of its own, copied from the settings in cache[0] when the simulation
+ * starts, and shares the levels below with the other cores.  Their L1s for data
+ * are kept coherent by MESI unless the settings say otherwise.
+ */
+struct cachesim {
+    struct cache cache[CACHE_LEVELS][2];
+    char split[CACHE_LEVELS];
+    uint_t levels;              // levels of cache, or 0 to go by deepest
+    uint_t deepest;             // the deepest level the settings describe
+    struct cache mm;
+    struct cachesim_core core[CACHE_CORES];
+    uint_t cores;               // cores running, 1 unless set before cachesim_start
+    cache_level l1i, l1d;       // core 0's L1s
+    struct coherence coherence;
+    struct cache_arena arena;
+};
+
+/*
+ * cachesim_init: clears a simulation before it is configured.  The L1 is split
+ * unless the settings say otherwise.
+ */
+void cachesim_init(struct cachesim *sim)
+{
+    memset(sim, 0, sizeof(struct cachesim));
+    sim->split[0] = 1;
+    sim->cores = 1;
+    sim->coherence.protocol = COHERENCE_MESI;
+}
+
+/*
+ * cachesim_cache: returns the cache on one side of level j, as a core sees it.
+ */
+static inline cache_level cachesim_cache(struct cachesim *sim, uint_t core, uint_t j, uint_t side)
+{
+    return j == 0 ? &sim->core[core].l1[side] : &sim->cache[j][side];
+}
+
+/*
+ * cachesim_name: writes the name of cache side of level j (L1i, L1d, L2, ...)
+ * into name.
+ *
+ * returns name
+ */
+const char * cachesim_name(struct cachesim *sim, uint_t j, uint_t side, char *name, uint_t size)
+{
+    if (sim->split[j])
+        snprintf(name, size, "L%u%c", j + 1, side ? 'd' : 'i');
+    else
+        snprintf(name, size, "L%u", j + 1);
+    return name;
+}
+
+/*
+ * cachesim_level: finishes initializing a cache from the parameters gathered from
+ * the configuration files, and links it to the next level down.
+ */
+void cachesim_level(cache_level cache, cache_level next)
+{
+    if (cache->block_size == 0 || cache->cache_size == 0) {
+        fprintf(stderr, "ERROR: a level of cache has no block_size or cache_size\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cache->assoc == 0)     // fully associative
+        cache->assoc = cache->cache_size / cache->block_size;
+    cache->sets_in_cache = cache->cache_size / (cache->assoc * cache->block_size);
+    cache->bits_in_tag = ADDR_BITS - lg(cache->sets_in_cache) - lg(cache->block_size);
+    cache_geometry(cache);
+    if (cache->policy == NULL)
+        cache->policy = &policy_lru;
+    if (cache->policy == &policy_plru && (cache->assoc & (cache->assoc - 1))) {
+        fprintf(stderr, "ERROR: plru needs a power of 2 ways, not %u\n", cache->assoc);
+        exit(EXIT_FAILURE);
+    }
+    cache->engine = engine_select(cache);
+    cache->next = next;
+}
+
+/*
+ * cachesim_start: builds the hierarchy once it is configured.
+ */
+void cachesim_start(struct cachesim *sim)
+{
+    cache_level caches[2 * (CACHE_LEVELS + CACHE_CORES)], l1d[CACHE_CORES], next;
+    uint_t j, c, side, n = 0;
+
+    if (sim->levels == 0)
+        sim->levels = sim->deepest;
+    if (sim->levels == 0) {
+        fprintf(stderr, "ERROR: the settings describe no levels of cache\n");
+        exit(EXIT_FAILURE);
+    }
+    if (sim->cores < 1 || sim->cores > CACHE_CORES) {
+        fprintf(stderr, "ERROR: there can be 1 to %u cores, not %u\n", CACHE_CORES, sim->cores);
+        exit(EXIT_FAILURE);
+    }
+
+    // every core's L1s start out as the settings of level 0
+    for (c=0; c<sim->cores; c++) {
+        sim->core[c].l1[0] = sim->cache[0][0];
+        sim->core[c].l1[1] = sim->cache[0][1];
+    }
+
+    for (j=0; j<sim->levels; j++) {
+        if (j + 1 < sim->levels && sim->split[j+1] && !sim->split[j]) {
+            fprintf(stderr, "ERROR: L%u is split, so L%u has to be too\n", j + 2, j + 1);
+            exit(EXIT_FAILURE);
+        }
+        for (side=0; side<=(uint_t) sim->split[j]; side++) {
+            if (j + 1 == sim->levels)
+                next = &sim->mm;
+            else
+                next = &sim->cache[j+1][sim->split[j+1] ? side : 0];
+            for (c=0; c<(j == 0 ? sim->cores : 1); c++) {
+                cachesim_level(cachesim_cache(sim, c, j, side), next);
+                caches[n++] = cachesim_cache(sim, c, j, side);
+            }
+
+            // only a single core's L1s see a stream of references that can be
+            // known ahead of time
+            if ((j > 0 || sim->cores > 1) && sim->cache[j][side].policy == &policy_opt) {
+                fprintf(stderr, "ERROR: opt is only for the L1 caches of a single core\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    sim->mm.next = NULL;
+    for (c=0; c<sim->cores; c++) {
+        sim->core[c].l1i = &sim->core[c].l1[0];
+        sim->core[c].l1d = l1d[c] = &sim->core[c].l1[sim->split[0] ? 1 : 0];
+        sim->core[c].l1d->coherent = sim->cores > 1 && sim->coherence.protocol != COHERENCE_NONE;
+    }
+    sim->l1i = sim->core[0].l1i;
+    sim->l1d = sim->core[0].l1d;
+
+    // allocate space for blocks in every cache in one go
+    arena_alloc(&sim->arena, caches, n);
+    if (sim->l1d->coherent)
+        coherence_start(&sim->coherence, l1d, sim->cores);
+}
+
+/*
+ * cachesim_end: frees the caches.
+ */
+void cachesim_end(struct cachesim *sim)
+{
+    arena_free(&sim->arena);
+    if (sim->l1d->coherent)
+        coherence_end(&sim->coherence);
+}
+
+/*
+ * cachesim_fetch: runs a fetch through one of a core's L1s, which keeps coherent
+ * with the other cores' if it is the one for data.
+ */
+static inline void cachesim_fetch(struct cachesim *sim, uint_t core, cache_level cache, addr_t addr, ulong_t *cycles)
+{
+    if (cache->coherent)
+        coherence_fetch(&sim->coherence, core, addr, cycles);
+    else
+        cache_fetch(cache, addr, cycles);
+}
+
+/*
+ * cachesim_simulate: runs one trace record of a core through the memory system.
+ */
+static inline void cachesim_simulate(struct cachesim *sim, uint_t core, char op, addr_t op_addr, addr_t byte_addr)
+{
+    struct cachesim_core *c = &sim->core[core];
+#ifdef DEBUG
+    static uint_t j = 0;
+    printf("inst %u, type = %c\n", j++, op);
+#endif
+
+    switch (op) {
+        case 'L':   // load word
+            c->num_load++;
+            cachesim_fetch(sim, core, c->l1i, op_addr, &c->load_cycles);
+            cachesim_fetch(sim, core, c->l1d, byte_addr, &c->load_cycles);
+            break;
+        case 'S':   // store word
+            c->num_store++;
+            cachesim_fetch(sim, core, c->l1i, op_addr, &c->store_cycles);
+            if (c->l1d->coherent)
+                coherence_store(&sim->coherence, core, byte_addr, &c->store_cycles);
+            else
+                cache_store(c->l1d, byte_addr, &c->store_cycles);
+            break;
+        case 'B':   // branch
+            c->num_branch++;
+            cachesim_fetch(sim, core, c->l1i, op_addr, &c->branch_cycles);
+            c->branch_cycles += 1;
+#ifdef DEBUG
+            printf("\tbranch time added (+1)\n");
+#endif
+            break;
+        case 'C':   // compute
+            c->num_comp++;
+            cachesim_fetch(sim, core, c->l1i, op_addr, &c->comp_cycles);
+            c->comp_cycles += byte_addr;
+#ifdef DEBUG
+            printf("\tcomputation time added (+%Lu)\n", (ulong_t) byte_addr);
+#endif
+            break;
+    }
+#ifdef DEBUG
+    printf("execution time: %Lu\n\n", c->load_cycles+c->store_cycles+c->branch_cycles+c->comp_cycles);
+#endif
+}
+
+/*
+ * cachesim_policy: writes what the report says about a cache's policy into label,
+ * which is nothing for the default, LRU.
+ *
+ * returns label
+ */
+const char * cachesim_policy(cache_level cache, char *label, uint_t size)
+{
+    label[0] = '\0';
+    if (cache->policy != &policy_lru)
+        snprintf(label, size, " : policy = %s", cache->policy->name);
+    return label;
+}
+
+/*
+ * cachesim_policy_stats: writes the line of the report with what a cache's policy
+ * did into line, which is nothing for policies that don't keep statistics.
+ *
+ * returns line
+ */
+const char * cachesim_policy_stats(cache_level cache, char *line, uint_t size)
+{
+    line[0] = '\0';
+    if (cache->policy->stats != NULL)
+        cache->policy->stats(cache, line, size);
+    return line;
+}
+
+/*
+ * cachesim_cost: returns what a cache at level j costs.
+ */
+uint_t cachesim_cost(cache_level cache, uint_t j)
+{
+    if (j == 0)
+        return (100 * cache->cache_size / 4096) * (lg(cache->assoc) + 1);
+    return (50 * cache->cache_size / 65536) + (50 * lg(cache->assoc));
+}
+
+/*
+ * cachesim_report_core: reports what instructions a core ran and the time they
+ * took.
+ */
+void cachesim_report_core(struct cachesim_core *c)
+{
+    ulong_t inst_refs = c->num_load + c->num_store + c->num_branch + c->num_comp;
+    ulong_t data_refs = c->num_load + c->num_store;
+    ulong_t total_refs = inst_refs + data_refs;
+    
+    ulong_t num_inst = c->num_load + c->num_store + c->num_branch + c->num_comp;
+    float perc_load = (float) c->num_load / num_inst * 100;
+    float perc_store = (float) c->num_store / num_inst * 100;
+    float perc_branch = (float) c->num_branch / num_inst * 100;
+    float perc_comp = (float) c->num_comp / num_inst * 100;
+    
+    ulong_t total_cycles = c->load_cycles + c->store_cycles + c->branch_cycles + c->comp_cycles;
+    float perc_load_cycles = (float) c->load_cycles / total_cycles * 100;
+    float perc_store_cycles = (float) c->store_cycles / total_cycles * 100;
+    float perc_branch_cycles = (float) c->branch_cycles / total_cycles * 100;
+    float perc_comp_cycles = (float) c->comp_cycles / total_cycles * 100;
+    
+    float load_cpi = (float) c->load_cycles / c->num_load;
+    float store_cpi = (float) c->store_cycles / c->num_store;
+    float branch_cpi = (float) c->branch_cycles / c->num_branch;
+    float comp_cpi = (float) c->comp_cycles / c->num_comp;
+    float overall_cpi = (float) total_cycles / num_inst;
+
+    ulong_t perf_cycles = 2 * num_inst;
+
+    // report statistics for execution time
+    printf("\
+Execute time = %Lu : Total refs = %Lu\n\
+Inst refs = %Lu : Data refs = %Lu\n\n",
+        total_cycles, total_refs,
+        inst_refs, data_refs);
+    // report number of instructions
+    printf("\
+Number of Instructions: [Percentage]\n\
+\tLoads  (L) = %Lu [%.1f%%] : Stores (S) = %Lu [%.1f%%]\n\
+\tBranch (B) = %Lu [%.1f%%] : Comp. (C) = %Lu [%.1f%%]\n\
+\tTotal  (T) = %Lu\n\n",
+        c->num_load, perc_load, c->num_store, perc_store,
+        c->num_branch, perc_branch, c->num_comp, perc_comp,
+        num_inst);
+    printf("\
+Cycles for Instructions: [Percentage]\n\
+\tLoads  (L) = %Lu [%.1f%%] : Stores (S) = %Lu [%.1f%%]\n\
+\tBranch (B) = %Lu [%.1f%%] : Comp. (C) = %Lu [%.1f%%]\n\
+\tTotal  (T) = %Lu\n\n",
+        c->load_cycles, perc_load_cycles, c->store_cycles, perc_store_cycles,
+        c->branch_cycles, perc_branch_cycles, c->comp_cycles, perc_comp_cycles,
+        total_cycles);
+    printf("\
+Cycles per Instruction (CPI):\n\
+\tLoads  (L) = %.1f : Stores (S) = %.1f\n\
+\tBranch (B) = %.1f : Comp. (C) = %.1f\n\
+\tOverall (CPI) = %.1f\n\n",
+        load_cpi, store_cpi, branch_cpi, comp_cpi, overall_cpi);
+    printf("\
+Cycles for processor w/ perfect memory system = %Lu\n\
+Cycles for processor w/ simulated memory system = %Lu\n\
+Ratio of simulated to perfect performance = %.1f\n\n",
+        perf_cycles, total_cycles, perf_cycles ? (float) (total_cycles / perf_cycles) : 0.0);
+}
+
+/*
+ * cachesim_report: Generates a report at the end of a simulation.
+ *
+ * NOTE: with more than one core each core's instructions are reported on their
+ * own, then all of them together, with the cycles of every core summed.
+ */
+void cachesim_report(struct cachesim *sim)
+{
+    uint_t mm_cost = 50 + (200 * ((100 / sim->mm.ready) - 1)) + 25 + (100 * ((sim->mm.chunksize / 16) - 1));
+    uint_t total_cost = mm_cost, cost[2], copies;
+
+    struct cachesim_core all;
+    cache_level cache;
+    ulong_t total_req;
+    char name[32], label[40], policy[32], stats[128], coherence[128], each[24];
+    uint_t j, k, c, side;
+
+    // report statistics passed in from config file, data before instructions
+    printf("Memory System:\n");
+    if (sim->cores > 1)
+        printf("\tCores = %u : each with L1 caches of its own\n", sim->cores);
+    if (sim->l1d->coherent)
+        printf("\tCoherence = %s : Snoops = %Lu : Snoops Filtered = %Lu\n",
+            coherence_names[(int) sim->coherence.protocol], sim->coherence.snoops, sim->coherence.filtered);
+    for (j=0; j<sim->levels; j++)
+        for (k=0; k<=(uint_t) sim->split[j]; k++) {
+            side = sim->split[j] - k;
+            cache = cachesim_cache(sim, 0, j, side);
+            if (j == 0 && sim->split[j])
+                snprintf(label, sizeof(label), "%ccache", side ? 'D' : 'I');
+            else
+                snprintf(label, sizeof(label), "%s-cache", cachesim_name(sim, j, side, name, sizeof(name)));
+            printf("\t%s size = %u : ways = %u : block size = %u%s\n", label,
+                cache->cache_size, cache->assoc, cache->block_size,
+                cachesim_policy(cache, policy, sizeof(policy)));
+        }
+    printf("\tMemory ready time = %u : chunksize = %u : chunktime = %u\n\n",
+        sim->mm.ready, sim->mm.chunksize, sim->mm.chunktime);
+
+    // report what the cores ran
+    if (sim->cores == 1) {
+        cachesim_report_core(&sim->core[0]);
+    } else {
+        memset(&all, 0, sizeof(all));
+        for (c=0; c<sim->cores; c++) {
+            printf("Core %u:\n", c);
+            cachesim_report_core(&sim->core[c]);
+            all.num_load += sim->core[c].num_load;
+            all.num_store += sim->core[c].num_store;
+            all.num_branch += sim->core[c].num_branch;
+            all.num_comp += sim->core[c].num_comp;
+            all.load_cycles += sim->core[c].load_cycles;
+            all.store_cycles += sim->core[c].store_cycles;
+            all.branch_cycles += sim->core[c].branch_cycles;
+            all.comp_cycles += sim->core[c].comp_cycles;
+        }
+        printf("All cores:\n");
+        cachesim_report_core(&all);
+    }
+
+    // report for each cache, instructions before data
+    for (j=0; j<sim->levels; j++)
+        for (c=0; c<(j == 0 ? sim->cores : 1); c++)
+            for (side=0; side<=(uint_t) sim->split[j]; side++) {
+                cache = cachesim_cache(sim, c, j, side);
+                total_req = cache->hit_count + cache->miss_count;
+                cachesim_name(sim, j, side, name, sizeof(name));
+                if (j == 0 && sim->cores > 1)
+                    snprintf(name + strlen(name), sizeof(name) - strlen(name), " (core %u)", c);
+                printf("\
+Memory Level: %s\n\
+\tHit Count = %Lu\tMiss Count = %Lu\tTotal Requests = %Lu\n\
+\tHit Rate = %.1f%%\tMiss Rate = %.1f%%\n \
+\tKickouts : %Lu Dirty Kickouts : %Lu Transfers : %Lu\n%s%s\n",
+                    name, cache->hit_count, cache->miss_count, total_req,
+                    (float) ((double) cache->hit_count / total_req * 100),
+                    (float) ((double) cache->miss_count / total_req * 100),
+                    cache->kickouts, cache->dirty_kickouts, cache->transfers,
+                    cachesim_policy_stats(cache, stats, sizeof(stats)),
+                    coherence_stats(cache, coherence, sizeof(coherence)));
+            }
+    // report cost statistics, every core paying for its own L1s
+    for (j=0; j<sim->levels; j++) {
+        cost[0] = cachesim_cost(cachesim_cache(sim, 0, j, 0), j);
+        cost[1] = sim->split[j] ? cachesim_cost(cachesim_cache(sim, 0, j, 1), j) : 0;
+        copies = j == 0 ? sim->cores : 1;
+        total_cost += copies * (cost[0] + cost[1]);
+        each[0] = '\0';
+        if (copies > 1)
+            snprintf(each, sizeof(each), " x %u cores", copies);
+        if (sim->split[j])
+            printf("L%u cache cost (Icache $%u) + (Dcache $%u)%s = $%u\n", j + 1, cost[0], cost[1], each,
+                    copies * (cost[0] + cost[1]));
+        else if (copies > 1)
+            printf("L%u cache cost ($%u)%s = $%u\n", j + 1, cost[0], each, copies * cost[0]);
+        else
+            printf("L%u cache cost = $%u\n", j + 1, cost[0]);
+    }
+    printf("\
+Memory Cost = $%u\n\
+Total Cost = $%u\n\n",
+    mm_cost, total_cost);
+}
+
+/*
+ * cachesim_config_policy: looks up the replacement policy named in a configuration
+ * file, and gives up if there is no such policy.
+ */
+const struct cache_policy * cachesim_config_policy(const char *cfile, const char *name)
+{
+    const struct cache_policy *policy = policy_select(name);
+
+    if (policy == NULL) {
+        fprintf(stderr, "ERROR: %s - unknown replacement policy %s (lru, fifo, random, plru, srrip, brrip, drrip or opt)\n", cfile, name);
+        exit(EXIT_FAILURE);
+    }
+    return policy;
+}
+
+/*
+ * cachesim_config_level: updates the parameters of level j from its group in a
+ * configuration file.  Both sides of the level get them, whether it ends up split
+ * or not.
+ */
+void cachesim_config_level(struct cachesim *sim, uint_t j, config_setting_t *setting, const char *cfile)
+{
+    int block_size, cache_size, assoc, hit_time, miss_time, transfer_time, bus_width, split;
+    const struct cache_policy *policy = NULL;
+    const char *name;
+    cache_level cache;
+    uint_t side;
+
+    if (config_setting_lookup_string(setting, "policy", &name))
+        policy = cachesim_config_policy(cfile, name);
+    if (config_setting_lookup_bool(setting, "split", &split))
+        sim->split[j] = split;
+    if (j + 1 > sim->deepest)
+        sim->deepest = j + 1;
+
+    for (side=0; side<2; side++) {
+        cache = &sim->cache[j][side];
+        if (config_setting_lookup_int(setting, "block_size", &block_size))
+            cache->block_size = block_size;
+        if (config_setting_lookup_int(setting, "cache_size", &cache_size))
+            cache->cache_size = cache_size;
+        if (config_setting_lookup_int(setting, "assoc", &assoc))
+            cache->assoc = assoc;
+        if (config_setting_lookup_int(setting, "hit_time", &hit_time))
+            cache->hit_time = hit_time;
+        if (config_setting_lookup_int(setting, "miss_time", &miss_time))
+            cache->miss_time = miss_time;
+        if (config_setting_lookup_int(setting, "transfer_time", &transfer_time))
+            cache->transfer_time = transfer_time;
+        if (config_setting_lookup_int(setting, "bus_width", &bus_width))
+            cache->bus_width = bus_width;
+        if (policy != NULL)
+            cache->policy = policy;
+    }
+}
+
+/*
+ * cachesim_config: Parses a cofniguration file and updates the specified parameters.
+ */
+void cachesim_config(struct cachesim *sim, const char *cfile)
+{
+    config_t cf, *cfg;
+    config_setting_t *setting;
+    const char *name;
+    char group[16];
+    int levels, protocol;
+    uint_t j;
+    
+    cfg = &cf;  // this is for pure convienece ;-D
+    config_init(cfg);
+    
+    /* check for errors in the configuration file */
+    if (!config_read_file(cfg, cfile)) {
+        fprintf(stderr, "ERROR: %s:%d - %s\n", config_error_file(cfg),
+                config_error_line(cfg), config_error_text(cfg));
+        config_destroy(cfg);
+        return;
+    }
+    
+    /* set the various parameters, L1_cache, L2_cache, ... for each level */
+    for (j=0; j<CACHE_LEVELS; j++) {
+        snprintf(group, sizeof(group), "L%u_cache", j + 1);
+        if ((setting = config_lookup(cfg, group)) != NULL)
+            cachesim_config_level(sim, j, setting, cfile);
+    }
+
+    if (config_lookup_int(cfg, "levels", &levels)) {
+        if (levels < 1 || levels > CACHE_LEVELS) {
+            fprintf(stderr, "ERROR: %s - levels has to be 1 to %u\n", cfile, CACHE_LEVELS);
+            exit(EXIT_FAILURE);
+        }
+        sim->levels = levels;
+    }
+
+    if (config_lookup_string(cfg, "coherence", &name)) {
+        if ((protocol = coherence_select(name)) < 0) {
+            fprintf(stderr, "ERROR: %s - unknown coherence protocol %s (none, mesi or moesi)\n", cfile, name);
+            exit(EXIT_FAILURE);
+        }
+        sim->coherence.protocol = protocol;
+    }
+    
+    if ((setting = config_lookup(cfg, "Main_Mem")) != NULL) {
+        int sendaddr, ready, chunktime, chunksize;
+        if (config_setting_lookup_int(setting, "sendaddr", &sendaddr))
+            sim->mm.sendaddr = sendaddr;
+        if (config_setting_lookup_int(setting, "ready", &ready))
+            sim->mm.ready = ready;
+        if (config_setting_lookup_int(setting, "chunktime", &chunktime))
+            sim->mm.chunktime = chunktime;
+        if (config_setting_lookup_int(setting, "chunksize", &chunksize))
+            sim->mm.chunksize = chunksize;
+    }
+    
+    config_destroy(cfg);
+}
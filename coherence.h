@@ -0,0 +1,373 @@
+/*
+ * coherence.h: implements MESI (or MOESI) coherence between the L1 caches of the
+ *              cores of a simulation.  A miss or a write to a shared block
+ *              snoops the other cores' copies, found through a snoop filter
+ *              kept at the shared level.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#define COHERENCE_NONE  0           // protocols: the L1s ignore each other,
+#define COHERENCE_MESI  1           // MESI,
+#define COHERENCE_MOESI 2           // and MESI with an owned state
+
+static const char *coherence_names[] = { "none", "mesi", "moesi" };
+
+/*
+ * struct coherence_slot: implements an entry of the snoop filter.  sharers is 0
+ * for an empty slot.
+ */
+struct coherence_slot {
+    addr_t block;
+    uint_t sharers;             // bit c is set if core c's L1 holds the block
+};
+
+/*
+ * struct coherence: holds the coherence of the L1 caches of several cores.
+ *
+ * NOTE: the state of a block in an L1 comes from its bits: invalid (I) if it
+ * isn't valid, otherwise modified (M) if it is dirty and exclusive (E) if not,
+ * unless shared is set, when it is owned (O) if dirty and shared (S) if not.  O
+ * only comes up with MOESI, where a dirty block another core reads stays dirty in
+ * its owner instead of being written back.  The snoop filter knows just which
+ * L1s hold each block, so only those are snooped rather than every other core.
+ */
+struct coherence {
+    char protocol;              // COHERENCE_NONE, COHERENCE_MESI or COHERENCE_MOESI
+    cache_level l1[CACHE_CORES];    // the L1 each core's data goes through
+    uint_t cores;
+
+    // the snoop filter, in an open addressing hash table
+    struct coherence_slot *table;
+    uint_t table_mask;
+
+    // a set of an L1 as it was before a miss, to tell which block the fill replaced
+    addr_t *old_tag;
+    ulong_t *old_valid;
+    ulong_t *old_shared;
+
+    ulong_t snoops;             // L1s looked in
+    ulong_t filtered;           // other L1s a snooping bus would have looked in too
+};
+
+/*
+ * coherence_select: looks up a protocol by name.
+ *
+ * returns the protocol, or -1 if there is no such protocol
+ */
+int coherence_select(const char *name)
+{
+    uint_t j;
+
+    for (j=0; j<sizeof(coherence_names)/sizeof(coherence_names[0]); j++)
+        if (!strcasecmp(name, coherence_names[j]))
+            return j;
+    return -1;
+}
+
+/*
+ * coherence_start: sets up the snoop filter once the n cores' L1s, all of the
+ * same geometry, are laid out.
+ */
+void coherence_start(struct coherence *coh, cache_level *l1, uint_t n)
+{
+    ulong_t blocks = (ulong_t) n * l1[0]->sets_in_cache * l1[0]->assoc;
+    uint_t j, size;
+
+    coh->cores = n;
+    for (j=0; j<n; j++)
+        coh->l1[j] = l1[j];
+
+    // every block the L1s hold at once fits with the table at most half full
+    for (size=2; size<2*blocks; size<<=1)
+        ;
+    coh->table = (struct coherence_slot *) ec_malloc(size * sizeof(struct coherence_slot));
+    coh->table_mask = size - 1;
+    coh->old_tag = (addr_t *) ec_malloc(l1[0]->assoc * sizeof(addr_t));
+    coh->old_valid = (ulong_t *) ec_malloc(l1[0]->words_per_set * sizeof(ulong_t));
+    coh->old_shared = (ulong_t *) ec_malloc(l1[0]->words_per_set * sizeof(ulong_t));
+}
+
+/*
+ * coherence_end: frees what coherence_start allocated.
+ */
+void coherence_end(struct coherence *coh)
+{
+    free(coh->table);
+    free(coh->old_tag);
+    free(coh->old_valid);
+    free(coh->old_shared);
+}
+
+/*
+ * coherence_slot: finds the slot of a block in the snoop filter, or the empty slot
+ * where it belongs.
+ */
+static inline uint_t coherence_slot(struct coherence *coh, addr_t block)
+{
+    uint_t h = addr_fold(block) * 0x9e3779b1u, j;
+
+    for (j=(h ^ (h >> 16)) & coh->table_mask; coh->table[j].sharers; j=(j+1) & coh->table_mask)
+        if (coh->table[j].block == block)
+            break;
+    return j;
+}
+
+/*
+ * coherence_add: records that core c's L1 holds block.
+ */
+static inline void coherence_add(struct coherence *coh, addr_t block, uint_t c)
+{
+    struct coherence_slot *slot = &coh->table[coherence_slot(coh, block)];
+
+    slot->block = block;
+    slot->sharers |= 1u << c;
+}
+
+/*
+ * coherence_drop: records that core c's L1 no longer holds block, shifting later
+ * slots of the run back once no L1 does, so that no search stops short.
+ */
+void coherence_drop(struct coherence *coh, addr_t block, uint_t c)
+{
+    struct coherence_slot *table = coh->table;
+    uint_t mask = coh->table_mask;
+    uint_t j = coherence_slot(coh, block), k, home, h;
+
+    if ((table[j].sharers &= ~(1u << c)) != 0)
+        return;
+    for (k=(j+1) & mask; table[k].sharers; k=(k+1) & mask) {
+        h = addr_fold(table[k].block) * 0x9e3779b1u;
+        home = (h ^ (h >> 16)) & mask;
+        if (((k - home) & mask) >= ((k - j) & mask)) {
+            table[j] = table[k];
+            j = k;
+        }
+    }
+    table[j].sharers = 0;
+}
+
+/*
+ * coherence_next: finds the next valid block from way on in the set of addr that
+ * holds it.  Only tag 0 can be held by more than one (see cache_update).
+ *
+ * returns its way, or assoc if there are no more
+ */
+static inline uint_t coherence_next(cache_level cache, addr_t addr, uint_t way)
+{
+    uint_t index = cache_index(cache, addr);
+    addr_t tag = cache_tag(cache, addr), *tags = cache->tag + index * cache->assoc;
+    ulong_t *valid = cache->valid + index * cache->words_per_set;
+
+    for (; way<cache->assoc; way++)
+        if (tags[way] == tag && BIT_TEST(valid, way))
+            break;
+    return way;
+}
+
+/*
+ * coherence_invalidate: takes the block of addr from core c's L1, if it holds it.
+ *
+ * NOTE: the block keeps its tag, marked stale, so the miss that brings it back
+ * can be told apart as a coherence miss.  Its stamp goes back to 0, and in a
+ * fully associative cache it goes to the front of the LRU list, so under LRU it
+ * is the next to be replaced, as an invalid block would be.
+ */
+void coherence_invalidate(struct coherence *coh, uint_t c, addr_t addr)
+{
+    cache_level cache = coh->l1[c];
+    uint_t index = cache_index(cache, addr), base = index * cache->words_per_set, way;
+
+    if ((way = coherence_next(cache, addr, 0)) < cache->assoc)
+        cache->invalidations++;
+    for (; way<cache->assoc; way=coherence_next(cache, addr, way+1)) {
+        BIT_CLEAR(cache->valid + base, way);
+        BIT_CLEAR(cache->dirty + base, way);
+        BIT_CLEAR(cache->shared + base, way);
+        BIT_SET(cache->stale + base, way);
+        cache->stamp[index * cache->assoc + way] = 0;
+        if (cache->table != NULL) {
+            cache_table_remove(cache, cache_tag(cache, addr), way);
+            cache_untouch(cache, way);
+        }
+    }
+    coherence_drop(coh, addr / cache->block_size, c);
+}
+
+/*
+ * coherence_snoop: looks in the L1s of the cores other than c that hold the block
+ * of addr.  A write takes the block from all of them; a read leaves them sharing
+ * it, a dirty copy being written back to the shared level under MESI or kept by
+ * its owner under MOESI.  Only a miss needs the block itself; a write to a block
+ * c shares already just takes the other copies.
+ *
+ * returns 1 if another L1 held the block dirty on a miss, and so hands it over
+ * itself, and sets *others if any L1 still holds it
+ */
+char coherence_snoop(struct coherence *coh, uint_t c, addr_t addr, char write, char miss, char *others)
+{
+    cache_level cache;
+    uint_t sharers, k, way, base;
+    addr_t block = addr / coh->l1[c]->block_size;
+    char dirty = 0;
+
+    sharers = coh->table[coherence_slot(coh, block)].sharers & ~(1u << c);
+    coh->snoops += __builtin_popcount(sharers);
+    coh->filtered += coh->cores - 1 - __builtin_popcount(sharers);
+    for (; sharers; sharers &= sharers - 1) {
+        k = __builtin_ctz(sharers);
+        cache = coh->l1[k];
+        base = cache_index(cache, addr) * cache->words_per_set;
+        for (way=coherence_next(cache, addr, 0); way<cache->assoc; way=coherence_next(cache, addr, way+1)) {
+            if (miss && BIT_TEST(cache->dirty + base, way)) {
+                cache->interventions++;
+                dirty = 1;
+                if (!write && coh->protocol == COHERENCE_MESI) {
+                    BIT_CLEAR(cache->dirty + base, way);
+                    if (cache->next->next != NULL)
+                        cache_write(cache->next, addr);
+                }
+            }
+            BIT_SET(cache->shared + base, way);
+        }
+        if (write)
+            coherence_invalidate(coh, k, addr);
+    }
+    if (others != NULL)
+        *others = !write && coh->table[coherence_slot(coh, block)].sharers & ~(1u << c);
+    return dirty;
+}
+
+/*
+ * coherence_share: sets or clears the shared bit of the blocks of core c's L1
+ * that hold addr.
+ */
+static inline void coherence_share(cache_level cache, addr_t addr, char shared)
+{
+    uint_t base = cache_index(cache, addr) * cache->words_per_set, way;
+
+    for (way=coherence_next(cache, addr, 0); way<cache->assoc; way=coherence_next(cache, addr, way+1))
+        if (shared)
+            BIT_SET(cache->shared + base, way);
+        else
+            BIT_CLEAR(cache->shared + base, way);
+}
+
+/*
+ * coherence_fill: brings the block of addr, which missed, into core c's L1, from
+ * another L1 if it holds it dirty or else from the levels below, and keeps the
+ * snoop filter up to date with the blocks the fill replaced.
+ *
+ * NOTE: a fill can change more than the one way it goes in, as a dirty kickout
+ * reads the block it kicks out again (see cache_kickout), which for tag 0 can
+ * land in another way.  So the whole set is compared with what it held before.
+ */
+void coherence_fill(struct coherence *coh, uint_t c, addr_t addr, char supplied, ulong_t *cycles)
+{
+    cache_level cache = coh->l1[c];
+    uint_t index = cache_index(cache, addr), base = index * cache->words_per_set;
+    addr_t tag = cache_tag(cache, addr), *tags = cache->tag + index * cache->assoc, old;
+    uint_t j, k;
+
+    // a miss to a block another core's write took is a coherence miss
+    for (j=0; j<cache->assoc; j++)
+        if (BIT_TEST(cache->stale + base, j) && !BIT_TEST(cache->valid + base, j) && tags[j] == tag)
+            break;
+    if (j < cache->assoc)
+        cache->coherence_misses++;
+
+    memcpy(coh->old_tag, tags, cache->assoc * sizeof(addr_t));
+    memcpy(coh->old_valid, cache->valid + base, cache->words_per_set * sizeof(ulong_t));
+    memcpy(coh->old_shared, cache->shared + base, cache->words_per_set * sizeof(ulong_t));
+    if (supplied) {
+        // comes over the bus from the other L1 instead of from the level below
+        cache_hit(cache, addr, cycles);
+        cache_kickout(cache, addr, cycles);
+        cache_transfer(cache, addr, cycles);
+    } else {
+        cache_fetch(cache, addr, cycles);
+    }
+
+    for (j=0; j<cache->assoc; j++) {
+        if (BIT_TEST(coh->old_valid, j) == BIT_TEST(cache->valid + base, j) && coh->old_tag[j] == tags[j])
+            continue;
+        BIT_CLEAR(cache->stale + base, j);
+
+        // a block replaced may still be held by another way (tag 0)
+        if (BIT_TEST(coh->old_valid, j)) {
+            old = (coh->old_tag[j] << cache->tag_shift) + (addr_t) index * cache->block_size;
+            if (coherence_next(cache, old, 0) == cache->assoc)
+                coherence_drop(coh, old / cache->block_size, c);
+        }
+
+        // and a block read again keeps the state it had
+        if (tags[j] != tag && BIT_TEST(cache->valid + base, j)) {
+            for (k=0; k<cache->assoc; k++)
+                if (BIT_TEST(coh->old_valid, k) && coh->old_tag[k] == tags[j])
+                    break;
+            if (k < cache->assoc && BIT_TEST(coh->old_shared, k))
+                BIT_SET(cache->shared + base, j);
+            else
+                BIT_CLEAR(cache->shared + base, j);
+        }
+    }
+    coherence_add(coh, addr / cache->block_size, c);
+}
+
+/*
+ * coherence_fetch: does what cache_fetch does for core c's L1, keeping it coherent
+ * with the others.
+ */
+void coherence_fetch(struct coherence *coh, uint_t c, addr_t addr, ulong_t *cycles)
+{
+    cache_level cache = coh->l1[c];
+    char supplied, others;
+
+    // a hit is readable in any state
+    if (cache_way(cache, addr) < cache->assoc) {
+        cache_fetch(cache, addr, cycles);
+        return;
+    }
+    supplied = coherence_snoop(coh, c, addr, 0, 1, &others);
+    coherence_fill(coh, c, addr, supplied, cycles);
+    coherence_share(cache, addr, others);   // S, or E if no other L1 has it
+}
+
+/*
+ * coherence_store: does what cache_store does for core c's L1, keeping it coherent
+ * with the others.
+ */
+void coherence_store(struct coherence *coh, uint_t c, addr_t addr, ulong_t *cycles)
+{
+    cache_level cache = coh->l1[c];
+    uint_t way = cache_way(cache, addr), base = cache_index(cache, addr) * cache->words_per_set;
+
+    if (way < cache->assoc) {
+        // M and E can be written as they are, S and O take the block from the others
+        if (BIT_TEST(cache->shared + base, way)) {
+            cache->upgrades++;
+            coherence_snoop(coh, c, addr, 1, 0, NULL);
+            coherence_share(cache, addr, 0);
+        }
+        cache_store(cache, addr, cycles);
+        return;
+    }
+    coherence_fill(coh, c, addr, coherence_snoop(coh, c, addr, 1, 1, NULL), cycles);
+    coherence_share(cache, addr, 0);
+    cache_write(cache, addr);
+}
+
+/*
+ * coherence_stats: writes the line of the report with what coherence did to a
+ * core's L1 into line.
+ *
+ * returns line
+ */
+const char * coherence_stats(cache_level cache, char *line, uint_t size)
+{
+    line[0] = '\0';
+    if (cache->coherent)
+        snprintf(line, size, "\tCoherence Misses : %Lu Invalidations : %Lu Upgrades : %Lu Interventions : %Lu\n",
+                cache->coherence_misses, cache->invalidations, cache->upgrades, cache->interventions);
+    return line;
+}
@@ -0,0 +1,137 @@
+/*
+ * convert.c: converts traces between the text format and our binary format.
+ *
+ * Run as follows:
+ *
+ *     ./cachesim-convert [-w 4|8] [-d] < <text trace> > <binary trace>
+ *     ./cachesim-convert -t < <binary trace> > <text trace>
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mycache.h"
+#include "trace.h"
+
+/*
+ * put_addr: writes addr to out as a little endian value n bytes wide.
+ */
+void put_addr(FILE *out, addr_t addr, int n)
+{
+    int j;
+    for (j=0; j<n; j++) {
+        putc(j < (int) sizeof(addr_t) ? (addr >> (8 * j)) & 0xff : 0, out);
+    }
+}
+
+/*
+ * put_varint: writes v to out as a little endian base 128 varint.
+ */
+void put_varint(FILE *out, ulong_t v)
+{
+    while (v >= 0x80) {
+        putc((v & 0x7f) | 0x80, out);
+        v >>= 7;
+    }
+    putc(v, out);
+}
+
+/*
+ * zigzag: returns the zigzag encoded difference between addr and last.
+ */
+ulong_t zigzag(addr_t addr, addr_t last)
+{
+#ifdef ADDR64
+    long long d = (long long) (addr - last);
+    return ((ulong_t) d << 1) ^ (ulong_t) (d >> 63);
+#else
+    int d = (int) (addr - last);
+    return (uint_t) ((d << 1) ^ (d >> 31));
+#endif
+}
+
+void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-w 4|8] [-d] [-t] < input > output\n", prog);
+    fprintf(stderr, "\t-w n\twrite binary addresses n bytes wide (default %d)\n", (int) sizeof(addr_t));
+    fprintf(stderr, "\t-d\twrite addresses as varint deltas (much smaller)\n");
+    fprintf(stderr, "\t-t\twrite a text trace instead of a binary one\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    char op;
+    addr_t op_addr, byte_addr;
+    struct trace trace;
+    struct trace_header h;
+    addr_t last_op = 0, last_data = 0;
+    char *code;
+    ulong_t d;
+    int j, width = sizeof(addr_t), text = 0, delta = 0;
+    FILE *out = stdout;
+
+    for (j=1; j<argc; j++) {
+        if (!strcmp(argv[j], "-t"))
+            text = 1;
+        else if (!strcmp(argv[j], "-d"))
+            delta = 1;
+        else if (!strcmp(argv[j], "-w") && j+1 < argc)
+            width = atoi(argv[++j]);
+        else
+            usage(argv[0]);
+    }
+    if (width != 4 && width != 8)
+        usage(argv[0]);
+
+    setvbuf(out, NULL, _IOFBF, TRACE_BUFSIZE);
+    trace_open(&trace, STDIN_FILENO);
+
+    if (!text) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+        h.version = TRACE_VERSION;
+        h.encoding = delta ? TRACE_VARINT : TRACE_FIXED;
+        h.addr_bytes = delta ? sizeof(addr_t) : width;
+        fwrite(&h, sizeof(h), 1, out);
+    }
+
+    while (trace_next(&trace, &op, &op_addr, &byte_addr)) {
+        if (text) {
+            fprintf(out, "%c %08Lx %Lx\n", op, (ulong_t) op_addr, (ulong_t) byte_addr);
+        } else if (delta) {
+            code = op ? strchr(TRACE_OPS, op) : NULL;
+            d = zigzag(op_addr, last_op);
+            if (d >> 61) {              // too big to shift over the op code
+                put_varint(out, TRACE_OP_WIDE);
+                putc(op, out);
+                put_varint(out, d);
+            } else if (code) {
+                put_varint(out, d << 3 | (code - TRACE_OPS));
+            } else {
+                put_varint(out, d << 3 | TRACE_OP_RAW);
+                putc(op, out);
+            }
+            last_op = op_addr;
+            if (op == 'L' || op == 'S') {
+                put_varint(out, zigzag(byte_addr, last_data));
+                last_data = byte_addr;
+            } else {
+                put_varint(out, byte_addr);
+            }
+        } else {
+            putc(op, out);
+            put_addr(out, op_addr, width);
+            put_addr(out, byte_addr, width);
+        }
+    }
+    trace_close(&trace);
+
+    if (fflush(out) == EOF) {
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
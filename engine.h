@@ -0,0 +1,96 @@
+/*
+ * engine.h: implements cache engines specialized at compile time for the
+ *           geometries we run most.  With the block size, number of sets and
+ *           associativity all constants, the index and tag come out of shifts
+ *           and masks and the loops over a set's ways are unrolled.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+/*
+ * CACHE_ENGINES: lists the geometries (block size, sets, ways) that get an engine:
+ * the defaults from .cacherc and those of the files in settings/.  Fully
+ * associative caches are left to the hash table in the generic code.
+ */
+#define CACHE_ENGINES(X) \
+    X(32, 256, 1)       /* L1 */ \
+    X(32, 128, 2)       /* L1, settings/l1-2w */ \
+    X(64, 1024, 1)      /* L2 */ \
+    X(64, 512, 2)       /* L2, settings/l2-2w */ \
+    X(64, 256, 4)       /* L2, settings/l2-4w */ \
+    X(64, 2048, 1)      /* L2, settings/l2-big */
+
+/*
+ * CACHE_ENGINE: defines the lookup and update functions of the engine for B byte
+ * blocks, S sets and A ways (at most 64, so a set's valid and dirty bits are one
+ * word).  They do just what cache_hit and cache_update do for a cache of that
+ * geometry, with a LRU policy.
+ */
+#define CACHE_ENGINE(B, S, A) \
+char engine_hit_##B##_##S##_##A(cache_level cache, addr_t addr, ulong_t *cycles) \
+{ \
+    uint_t index = (uint_t) ((addr / B) % S); \
+    addr_t tag = addr / (B * S); \
+    const addr_t *tags = cache->tag + index * A; \
+    ulong_t valid = cache->valid[index]; \
+    uint_t j; \
+    char hit = 0; \
+\
+    for (j=0; j<A; j++) \
+        hit |= ((valid >> j) & 1) && tags[j] == tag; \
+    return cache_count(cache, index, tag, hit, cycles); \
+} \
+\
+void engine_update_##B##_##S##_##A(cache_level cache, addr_t addr, char dirty) \
+{ \
+    uint_t index = (uint_t) ((addr / B) % S); \
+    addr_t tag = addr / (B * S); \
+    addr_t *tags = cache->tag + index * A; \
+    ulong_t *stamp = cache->stamp + index * A; \
+    uint_t j, way = A; \
+\
+    for (j=0; j<A; j++) \
+        if (tags[j] == tag && (way == A || stamp[j] < stamp[way])) \
+            way = j; \
+    if (way == A) \
+        for (way=0, j=1; j<A; j++) \
+            if (stamp[j] < stamp[way]) \
+                way = j; \
+\
+    cache->valid[index] |= 1ULL << way; \
+    cache->dirty[index] = (cache->dirty[index] & ~(1ULL << way)) | ((ulong_t) (dirty != 0) << way); \
+    tags[way] = tag; \
+    stamp[way] = ++cache->clock; \
+    cache_updated(cache, index, tag, dirty); \
+}
+
+CACHE_ENGINES(CACHE_ENGINE)
+
+#define ENGINE_ENTRY(B, S, A) \
+    { B, S, A, engine_hit_##B##_##S##_##A, engine_update_##B##_##S##_##A },
+
+static const struct cache_engine engines[] = {
+    CACHE_ENGINES(ENGINE_ENTRY)
+};
+
+/*
+ * engine_select: picks the engine built for the cache's geometry.  Setting
+ * CACHESIM_ENGINE to generic always runs the generic code.  The engines only
+ * replace blocks by LRU, so caches with another policy never get one.
+ *
+ * returns the engine, or NULL if there is none for this geometry
+ */
+const struct cache_engine * engine_select(cache_level cache)
+{
+    const char *want = getenv("CACHESIM_ENGINE");
+    uint_t j;
+
+    if ((want && !strcmp(want, "generic")) || cache->policy != &policy_lru)
+        return NULL;
+    for (j=0; j<sizeof(engines)/sizeof(engines[0]); j++)
+        if (engines[j].block_size == cache->block_size
+                && engines[j].sets_in_cache == cache->sets_in_cache
+                && engines[j].assoc == cache->assoc)
+            return &engines[j];
+    return NULL;
+}
@@ -0,0 +1,412 @@
+/*
+ * epoch.h: implements the parallel simulation of several cores.  The merged
+ *          trace goes a batch (an epoch) at a time: worker threads run each
+ *          core's part of it through the core's own L1s at once, queuing what
+ *          they need of the shared levels and the other cores, then the main
+ *          thread carries out the queued requests in the order of the trace.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#include <pthread.h>
+
+#define EPOCH_FETCH     0           // requests: the levels below an L1 that missed,
+#define EPOCH_WRITEBACK 1           // a dirty block kicked out of an L1,
+#define EPOCH_READ      2           // a read miss of a coherent L1,
+#define EPOCH_WRITE     3           // a write miss of one,
+#define EPOCH_UPGRADE   4           // a write to a block it shares,
+#define EPOCH_SYNC      5           // and a block it took in or gave up
+#define EPOCH_REQUESTS  8           // requests a record can make at most
+
+/*
+ * struct epoch_request: implements a request an L1 leaves for the main thread.
+ */
+struct epoch_request {
+    addr_t addr;
+    cache_level cache;          // the L1 that made it
+    ulong_t *cycles;            // the core's cycles it counts toward
+    uint_t rec;                 // the record that made it, in the batch
+    char kind;                  // EPOCH_FETCH, EPOCH_WRITEBACK, ...
+};
+
+/*
+ * struct epoch_queue: holds the requests one core made over the batch.  Only the
+ * worker running the core adds to it, and only once the workers are through does
+ * the main thread read it, so it needs no lock.
+ */
+struct epoch_queue {
+    struct epoch_request *request;
+    uint_t n;
+    uint_t next;                // the next one the main thread carries out
+
+    // a set of a coherent L1 as it was before a miss, to tell which block the fill replaced
+    addr_t *old_tag;
+    ulong_t *old_valid;
+};
+
+/*
+ * struct epoch_worker: implements one worker thread.
+ */
+struct epoch_worker {
+    struct epoch *epoch;
+    uint_t id;
+    pthread_t thread;
+};
+
+/*
+ * struct epoch: holds the workers and the batch they work on.
+ *
+ * NOTE: core c runs on worker c % nworkers.  What a core does in its own L1s
+ * can run ahead of the other cores for as long as it doesn't depend on them.
+ * An instruction L1 of a split level never does: it is never written, so never
+ * dirty, never kept coherent, and nothing below it changes how it behaves.  So
+ * by default only the instruction L1s run on the workers, the loads and stores
+ * go through the hierarchy on the main thread as they would without the workers,
+ * and the report comes out exactly the same as without them.
+ *
+ * relaxed runs the L1s for data on the workers too, which is faster but only
+ * approximate: a core sees what the others did to its L1 (invalidations, blocks
+ * they read from it) only at the end of the batch, and the block a dirty kickout
+ * writes back is not read into the L1 again (see cache_kickout).
+ */
+struct epoch {
+    struct cachesim *sim;
+    char relaxed;
+    struct epoch_queue queue[CACHE_CORES];
+    struct epoch_worker *worker;
+    uint_t nworkers;
+
+    // the batch being simulated
+    struct trace_batch *batch;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;       // a batch is ready, or the workers are stopping
+    pthread_cond_t done;        // every worker is through with the batch
+    uint_t round;               // counts the batches handed out
+    uint_t busy;                // workers still on this round's batch
+    char stop;
+};
+
+/*
+ * epoch_cycles: returns where a core counts the cycles of an instruction, or NULL
+ * for a record cachesim_simulate skips.
+ */
+static inline ulong_t * epoch_cycles(struct cachesim_core *k, char op)
+{
+    switch (op) {
+        case 'L':   return &k->load_cycles;
+        case 'S':   return &k->store_cycles;
+        case 'B':   return &k->branch_cycles;
+        case 'C':   return &k->comp_cycles;
+    }
+    return NULL;
+}
+
+/*
+ * epoch_queue: adds a request to a core's queue.
+ */
+static inline void epoch_queue(struct epoch_queue *q, char kind, cache_level cache, uint_t rec, addr_t addr, ulong_t *cycles)
+{
+    struct epoch_request *r = &q->request[q->n++];
+
+    r->addr = addr;
+    r->cache = cache;
+    r->cycles = cycles;
+    r->rec = rec;
+    r->kind = kind;
+}
+
+/*
+ * epoch_kickout: does what cache_kickout does for a core's L1, queuing the write
+ * back of a dirty block to the level below instead of doing it.
+ */
+static void epoch_kickout(struct epoch_queue *q, cache_level l1, uint_t rec, addr_t addr, ulong_t *cycles)
+{
+    uint_t index = cache_index(l1, addr), lru = l1->policy->choose_victim(l1, index);
+
+    if (!BIT_TEST(l1->valid + index * l1->words_per_set, lru))
+        return;
+    l1->kickouts++;
+    if (!BIT_TEST(l1->dirty + index * l1->words_per_set, lru))
+        return;
+    l1->dirty_kickouts++;
+    if (l1->next->next != NULL)
+        epoch_queue(q, EPOCH_WRITEBACK, l1, rec,
+                (l1->tag[index * l1->assoc + lru] << l1->tag_shift) + (addr_t) index * l1->block_size, cycles);
+}
+
+/*
+ * epoch_access: runs a reference through one of a core's L1s, on the core's
+ * worker, queuing what it needs of the levels below and of the other cores.
+ */
+static void epoch_access(struct epoch_queue *q, cache_level cache, uint_t rec, addr_t addr, ulong_t *cycles, char write)
+{
+    uint_t index = cache_index(cache, addr), base = index * cache->words_per_set, j;
+    addr_t tag = cache_tag(cache, addr), *tags = cache->tag + index * cache->assoc, old;
+
+    if (cache_hit(cache, addr, cycles)) {
+        // M and E can be written as they are, S and O take the block from the others
+        if (write && cache->coherent && BIT_TEST(cache->shared + base, coherence_next(cache, addr, 0))) {
+            cache->upgrades++;
+            epoch_queue(q, EPOCH_UPGRADE, cache, rec, addr, cycles);
+            coherence_share(cache, addr, 0);
+        }
+        if (write)
+            cache_write(cache, addr);
+        return;
+    }
+
+    if (cache->coherent) {
+        // a miss to a block another core's write took is a coherence miss
+        for (j=0; j<cache->assoc; j++)
+            if (BIT_TEST(cache->stale + base, j) && !BIT_TEST(cache->valid + base, j) && tags[j] == tag)
+                break;
+        if (j < cache->assoc)
+            cache->coherence_misses++;
+        memcpy(q->old_tag, tags, cache->assoc * sizeof(addr_t));
+        memcpy(q->old_valid, cache->valid + base, cache->words_per_set * sizeof(ulong_t));
+    }
+
+    epoch_kickout(q, cache, rec, addr, cycles);
+    if (cache->coherent)
+        epoch_queue(q, write ? EPOCH_WRITE : EPOCH_READ, cache, rec, addr, cycles);
+    else if (cache->next->next != NULL)
+        epoch_queue(q, EPOCH_FETCH, cache, rec, addr, cycles);
+    cache_transfer(cache, addr, cycles);
+
+    // the snoop filter learns of the blocks that came and went with the rest
+    if (cache->coherent) {
+        for (j=0; j<cache->assoc; j++) {
+            if (BIT_TEST(q->old_valid, j) == BIT_TEST(cache->valid + base, j) && q->old_tag[j] == tags[j])
+                continue;
+            BIT_CLEAR(cache->stale + base, j);
+            if (BIT_TEST(q->old_valid, j)) {
+                old = (q->old_tag[j] << cache->tag_shift) + (addr_t) index * cache->block_size;
+                if (coherence_next(cache, old, 0) == cache->assoc)
+                    epoch_queue(q, EPOCH_SYNC, cache, rec, old, cycles);
+            }
+        }
+        epoch_queue(q, EPOCH_SYNC, cache, rec, addr, cycles);
+        coherence_share(cache, addr, 0);    // E or M until the read is carried out
+    }
+    if (write)
+        cache_write(cache, addr);
+}
+
+/*
+ * epoch_private: runs what a record of core c needs of its own L1s, on the core's
+ * worker.
+ */
+static void epoch_private(struct epoch *e, uint_t c, uint_t rec, char op, addr_t op_addr, addr_t byte_addr)
+{
+    struct cachesim_core *k = &e->sim->core[c];
+    ulong_t *cycles = epoch_cycles(k, op);
+
+    if (cycles == NULL)
+        return;
+    if (op == 'L')
+        k->num_load++;
+    else if (op == 'S')
+        k->num_store++;
+    else if (op == 'B')
+        k->num_branch++;
+    else
+        k->num_comp++;
+
+    if (e->relaxed || k->l1i != k->l1d)
+        epoch_access(&e->queue[c], k->l1i, rec, op_addr, cycles, 0);
+    if (e->relaxed && (op == 'L' || op == 'S'))
+        epoch_access(&e->queue[c], k->l1d, rec, byte_addr, cycles, op == 'S');
+
+    if (op == 'B')
+        *cycles += 1;
+    else if (op == 'C')
+        *cycles += byte_addr;
+}
+
+/*
+ * epoch_request: carries out a request on the main thread.
+ */
+static void epoch_request(struct epoch *e, uint_t c, struct epoch_request *r)
+{
+    struct coherence *coh = &e->sim->coherence;
+    cache_level cache = r->cache, next = cache->next;
+    addr_t block = r->addr / cache->block_size;
+    char below = next->next != NULL, others;
+
+    switch (r->kind) {
+        case EPOCH_FETCH:
+            cache_fetch(next, r->addr, r->cycles);
+            break;
+        case EPOCH_WRITEBACK:
+            // as cache_kickout does, short of reading the block into the L1 again
+            if (cache_hit(next, r->addr, r->cycles))
+                *r->cycles += next->transfer_time * (cache->block_size / next->bus_width);
+            cache_write(next, r->addr);
+            break;
+        case EPOCH_READ:
+            if (!coherence_snoop(coh, c, r->addr, 0, 1, &others) && below)
+                cache_fetch(next, r->addr, r->cycles);
+            coherence_share(cache, r->addr, others);
+            break;
+        case EPOCH_WRITE:
+            if (!coherence_snoop(coh, c, r->addr, 1, 1, NULL) && below)
+                cache_fetch(next, r->addr, r->cycles);
+            break;
+        case EPOCH_UPGRADE:
+            coherence_snoop(coh, c, r->addr, 1, 0, NULL);
+            break;
+        case EPOCH_SYNC:
+            // the L1 may have moved on since; the filter goes by what it holds now
+            if (coherence_next(cache, r->addr, 0) < cache->assoc)
+                coherence_add(coh, block, c);
+            else if (coh->table[coherence_slot(coh, block)].sharers & (1u << c))
+                coherence_drop(coh, block, c);
+            break;
+    }
+}
+
+/*
+ * epoch_work: the body of a worker thread.
+ */
+void * epoch_work(void *arg)
+{
+    struct epoch_worker *w = (struct epoch_worker *) arg;
+    struct epoch *e = w->epoch;
+    struct trace_batch *b;
+    uint_t round = 0, j, c;
+
+    for (;;) {
+        pthread_mutex_lock(&e->lock);
+        while (e->round == round && !e->stop)
+            pthread_cond_wait(&e->start, &e->lock);
+        if (e->stop) {
+            pthread_mutex_unlock(&e->lock);
+            return NULL;
+        }
+        round = e->round;
+        b = e->batch;
+        pthread_mutex_unlock(&e->lock);
+
+        for (c=w->id; c<e->sim->cores; c+=e->nworkers)
+            e->queue[c].n = e->queue[c].next = 0;
+        for (j=0; j<b->n; j++)
+            if (b->core[j] % e->nworkers == w->id)
+                epoch_private(e, b->core[j], j, b->op[j], b->op_addr[j], b->byte_addr[j]);
+
+        pthread_mutex_lock(&e->lock);
+        if (--e->busy == 0)
+            pthread_cond_signal(&e->done);
+        pthread_mutex_unlock(&e->lock);
+    }
+}
+
+/*
+ * epoch_start: starts n workers for the cores of a simulation, relaxed or not.
+ */
+void epoch_start(struct epoch *e, struct cachesim *sim, uint_t n, char relaxed)
+{
+    cache_level l1d = sim->l1d;
+    uint_t j;
+
+    e->sim = sim;
+    e->relaxed = relaxed;
+    e->nworkers = n < sim->cores ? n : sim->cores;
+    e->worker = (struct epoch_worker *) ec_malloc(e->nworkers * sizeof(struct epoch_worker));
+    e->round = e->busy = 0;
+    e->stop = 0;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->start, NULL);
+    pthread_cond_init(&e->done, NULL);
+
+    for (j=0; j<sim->cores; j++) {
+        e->queue[j].request = (struct epoch_request *)
+                ec_malloc(EPOCH_REQUESTS * TRACE_BATCH * sizeof(struct epoch_request));
+        e->queue[j].old_tag = (addr_t *) ec_malloc(l1d->assoc * sizeof(addr_t));
+        e->queue[j].old_valid = (ulong_t *) ec_malloc(l1d->words_per_set * sizeof(ulong_t));
+    }
+    for (j=0; j<e->nworkers; j++) {
+        e->worker[j].epoch = e;
+        e->worker[j].id = j;
+        if ((errno = pthread_create(&e->worker[j].thread, NULL, epoch_work, &e->worker[j])) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*
+ * epoch_run: starts the workers on a batch.
+ */
+void epoch_run(struct epoch *e, struct trace_batch *b)
+{
+    pthread_mutex_lock(&e->lock);
+    e->batch = b;
+    e->busy = e->nworkers;
+    e->round++;
+    pthread_cond_broadcast(&e->start);
+    pthread_mutex_unlock(&e->lock);
+}
+
+/*
+ * epoch_wait: waits for the workers to finish the batch, then carries out the
+ * requests they queued, and unless relaxed the rest of each record, in the order
+ * of the trace.
+ */
+void epoch_wait(struct epoch *e)
+{
+    struct trace_batch *b = e->batch;
+    struct cachesim *sim = e->sim;
+    struct cachesim_core *k;
+    struct epoch_queue *q;
+    ulong_t *cycles;
+    uint_t j, c;
+
+    pthread_mutex_lock(&e->lock);
+    while (e->busy > 0)
+        pthread_cond_wait(&e->done, &e->lock);
+    pthread_mutex_unlock(&e->lock);
+
+    for (j=0; j<b->n; j++) {
+        c = b->core[j];
+        q = &e->queue[c];
+        while (q->next < q->n && q->request[q->next].rec == j)
+            epoch_request(e, c, &q->request[q->next++]);
+        if (e->relaxed || (cycles = epoch_cycles(k = &sim->core[c], b->op[j])) == NULL)
+            continue;
+
+        if (k->l1i == k->l1d)
+            cachesim_fetch(sim, c, k->l1i, b->op_addr[j], cycles);
+        if (b->op[j] == 'L')
+            cachesim_fetch(sim, c, k->l1d, b->byte_addr[j], cycles);
+        else if (b->op[j] == 'S' && k->l1d->coherent)
+            coherence_store(&sim->coherence, c, b->byte_addr[j], cycles);
+        else if (b->op[j] == 'S')
+            cache_store(k->l1d, b->byte_addr[j], cycles);
+    }
+}
+
+/*
+ * epoch_stop: stops the workers and frees what epoch_start allocated.
+ */
+void epoch_stop(struct epoch *e)
+{
+    uint_t j;
+
+    pthread_mutex_lock(&e->lock);
+    e->stop = 1;
+    pthread_cond_broadcast(&e->start);
+    pthread_mutex_unlock(&e->lock);
+
+    for (j=0; j<e->nworkers; j++)
+        pthread_join(e->worker[j].thread, NULL);
+    for (j=0; j<e->sim->cores; j++) {
+        free(e->queue[j].request);
+        free(e->queue[j].old_tag);
+        free(e->queue[j].old_valid);
+    }
+    free(e->worker);
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->start);
+    pthread_cond_destroy(&e->done);
+}
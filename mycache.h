@@ -7,33 +7,125 @@
 
 //#define DEBUG
 
+#include <sys/mman.h>
+
 #define DIRTY   1
 #define NODIRTY 0
 
+#if defined(__x86_64__) || defined(__i386__)
+#define CACHE_X86
+#include <immintrin.h>
+#endif
+
+#define CACHE_ALIGN     64          // alignment of the block arrays (a cache line)
+#define MATCH_PAD       8           // tags a match kernel may read past a set
+#define ARENA_HUGEPAGE  (1<<21)     // arenas this big are backed by huge pages
+#define CACHE_LEVELS    8           // most levels of cache in a hierarchy
+#define CACHE_CORES     16          // most cores sharing a hierarchy
+#define CACHE_SEED      0x9e3779b97f4a7c15ULL   // starts the random policies' generator
+#define CACHE_PSEL      1023        // top of DRRIP's set dueling counter
+
+// the valid and dirty bits of a set are bitmasks of 64 bit words
+#define BIT_TEST(m, j)  (((m)[(j) >> 6] >> ((j) & 63)) & 1)
+#define BIT_SET(m, j)   ((m)[(j) >> 6] |= 1ULL << ((j) & 63))
+#define BIT_CLEAR(m, j) ((m)[(j) >> 6] &= ~(1ULL << ((j) & 63)))
+
 typedef unsigned int uint_t;
 typedef unsigned long long ulong_t;
 
-ulong_t num_load = 0;
-ulong_t num_store = 0;
-ulong_t num_branch = 0;
-ulong_t num_comp = 0;
+/*
+ * Addresses, and the tags cut from them, are 32 bits unless ADDR64 is defined at
+ * compile time for the traces of 64 bit programs.  The 32 bit build keeps half
+ * the tag storage, so more of each cache's sets fit in the host's caches.
+ */
+#ifdef ADDR64
+typedef unsigned long long addr_t;
+#define ADDR_BITS       64
+#define ADDR_DIGITS     16          // hex digits in an address
+#else
+typedef unsigned int addr_t;
+#define ADDR_BITS       32
+#define ADDR_DIGITS     8
+#endif
 
-ulong_t load_cycles = 0;
-ulong_t store_cycles = 0;
-ulong_t branch_cycles = 0;
-ulong_t comp_cycles = 0;
-static ulong_t * cycles;
+/*
+ * addr_fold: folds an address (or a tag or block number cut from one) down to 32
+ * bits, to be hashed.
+ */
+static inline uint_t addr_fold(addr_t a)
+{
+#ifdef ADDR64
+    return (uint_t) (a ^ (a >> 32));
+#else
+    return a;
+#endif
+}
+
+/*
+ * ec_malloc: performs malloc with error checking and sets memory to 0 (for thoroughness).
+ */
+void * ec_malloc(ulong_t size) 
+{
+    void *j;
+    if ((j = malloc(size)) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(j, 0, size);
+    return j;
+}
 
-typedef struct cache_block * cache_set;
 typedef struct cache * cache_level;
 
+/*
+ * A match kernel compares n (at most 64) tags against tag, and returns a mask
+ * with bit j set if tags[j] matches.
+ */
+typedef ulong_t (*match_kernel)(const addr_t *tags, addr_t tag, uint_t n);
+
+/*
+ * struct cache_engine: implements lookups and updates specialized at compile time
+ * for one geometry (see engine.h).
+ */
+struct cache_engine {
+    uint_t block_size;
+    uint_t sets_in_cache;
+    uint_t assoc;
+    char (*hit)(cache_level cache, addr_t addr, ulong_t *cycles);
+    void (*update)(cache_level cache, addr_t addr, char dirty);
+};
+
+/*
+ * struct cache_policy: implements a replacement policy (see policy.h).
+ *
+ * NOTE: on_hit is called for every lookup that hits, read or write, and on_fill
+ * when a block is given a new tag, so each reference to a cache is one or the
+ * other.  on_update is called when a block that already held the tag is written
+ * again; only LRU wants it, as it has always counted updates rather than hits as
+ * uses (the stamps cache_update keeps).  choose_victim must keep returning the
+ * same way until the next on_fill, since a miss asks for it once to kick the
+ * block out and again to fill it.
+ */
+struct cache_policy {
+    const char *name;
+    uint_t meta_bits;           // bits of state per way of each set
+    void (*on_hit)(cache_level cache, uint_t index, uint_t way);       // or NULL
+    void (*on_fill)(cache_level cache, uint_t index, uint_t way);
+    void (*on_update)(cache_level cache, uint_t index, uint_t way);    // or NULL
+    uint_t (*choose_victim)(cache_level cache, uint_t index);
+    void (*stats)(cache_level cache, char *line, uint_t size);     // for the report, or NULL
+};
+
 /*
  * cache: this implements all the paramaters for 1 level of cache required for this
  * simulation.
  * 
- * NOTE: I implement an array of cache_block structs. Because the number of blocks 
- * depends on parameters that are passed by the configuration file.  This array 
- * must be initialized at runtime.
+ * NOTE: The blocks are kept as one array per field rather than an array of
+ * structs, so that a whole set's tags can be compared at once.  Block j of set
+ * index is at index * assoc + j in tag and stamp, and its valid and dirty bits
+ * are bit j of the index * words_per_set words of valid and dirty.  Because the
+ * number of blocks depends on parameters that are passed by the configuration
+ * file, the arrays must be allocated at runtime (see arena_alloc).
  */
 struct cache {
     // cache params
@@ -46,6 +138,12 @@ struct cache {
     uint_t bus_width;
     uint_t sets_in_cache;
     uint_t bits_in_tag;
+
+    // splitting addresses, precomputed by cache_geometry
+    char pow2;                  // block_size and sets_in_cache are powers of 2
+    uint_t offset_bits;
+    uint_t index_mask;
+    uint_t tag_shift;
     
     // main memory params
     uint_t sendaddr;
@@ -60,22 +158,95 @@ struct cache {
     ulong_t dirty_kickouts;
     ulong_t transfers;
 
-    // holds an array of cache sets
-    cache_set * set;
+    // counts updates, used to stamp blocks for LRU
+    ulong_t clock;
+
+    // the replacement policy and its state
+    const struct cache_policy * policy;
+    ulong_t * meta;             // meta_words words per set, if the policy keeps any
+    uint_t meta_words;
+    ulong_t rand;               // the random policies' generator
+    uint_t psel;                // DRRIP's set dueling counter
+    const uint_t * next_use;    // OPT's oracle: when each reference's block is next used
+    ulong_t refs;               // lookups of the cache so far, which index next_use
+
+    // what the policy did, for the report
+    ulong_t long_fills;         // RRIP fills predicted to be used again soon
+    ulong_t distant_fills;      // RRIP fills predicted not to be
+    ulong_t agings;             // RRIP victim searches that had to age the set
+
+    // coherence with the other cores' L1s, for a core's L1 (see coherence.h)
+    char coherent;
+    ulong_t * shared;           // other L1s may hold the block too (S, or O if dirty)
+    ulong_t * stale;            // the block was taken by another core's write
+    ulong_t coherence_misses;   // misses to blocks taken that way
+    ulong_t invalidations;      // blocks taken that way
+    ulong_t upgrades;           // writes to shared blocks, taking them from the others
+    ulong_t interventions;      // dirty blocks handed over to other cores
+
+    // the blocks of every set
+    addr_t * tag;
+    ulong_t * stamp;            // the clock at each block's last update, 0 if never filled
+    ulong_t * valid;
+    ulong_t * dirty;
+    uint_t words_per_set;       // words of valid/dirty bits per set
+    match_kernel match;
+    const struct cache_engine * engine;     // specialized code for this geometry, or NULL
+
+    // fully associative caches only: a hash table from tag to way, and the ways
+    // in LRU order as a doubly linked list
+    struct cache_slot * table;
+    uint_t table_mask;
+    uint_t * lru_prev;
+    uint_t * lru_next;
+    uint_t lru_head;
+    uint_t lru_tail;
 
     // points to next cache layer
     cache_level next;
 };
 
 /*
- * struct cache_block: implements a cache block
+ * struct cache_slot: implements an entry of a fully associative cache's hash table.
+ * way is stored plus one, so a zeroed slot is empty.
  */
-struct cache_block {
-    char valid;
-    char dirty;
-    uint_t tag;
+struct cache_slot {
+    addr_t tag;
+    uint_t way;
 };
 
+/*
+ * cache_geometry: precomputes the shifts and masks that split an address, once
+ * the cache's geometry is known.  They are only used if block_size and
+ * sets_in_cache are both powers of 2; otherwise every access divides.
+ */
+void cache_geometry(cache_level cache)
+{
+    cache->pow2 = cache->block_size && !(cache->block_size & (cache->block_size - 1))
+        && cache->sets_in_cache && !(cache->sets_in_cache & (cache->sets_in_cache - 1));
+    cache->offset_bits = cache->pow2 ? __builtin_ctz(cache->block_size) : 0;
+    cache->index_mask = cache->sets_in_cache - 1;
+    cache->tag_shift = ADDR_BITS - cache->bits_in_tag;
+}
+
+/*
+ * cache_index: returns the index of the set addr maps to.
+ */
+static inline uint_t cache_index(cache_level cache, addr_t addr)
+{
+    if (cache->pow2)
+        return (uint_t) (addr >> cache->offset_bits) & cache->index_mask;
+    return (uint_t) ((addr / cache->block_size) % cache->sets_in_cache);
+}
+
+/*
+ * cache_tag: returns the tag of addr.
+ */
+static inline addr_t cache_tag(cache_level cache, addr_t addr)
+{
+    return addr >> cache->tag_shift;
+}
+
 #ifdef DEBUG
 /*
  * cache_print_sets: prints the contents of each nonempty set in the cache
@@ -85,12 +256,15 @@ void cache_print_sets(cache_level cache)
     uint_t j, n, d;
 
     for (j=0; j<cache->sets_in_cache; j++) {
+        ulong_t *valid = cache->valid + j * cache->words_per_set;
+        ulong_t *dirty = cache->dirty + j * cache->words_per_set;
+
         n=0;
         for (d=0; d<cache->assoc; d++)
-            if (cache->set[j][d].valid) {
-                printf("| index: %4x valid: %x dirty: %x tag: %8x ",
-                        j, cache->set[j][d].valid, cache->set[j][d].dirty, 
-                        cache->set[j][d].tag);
+            if (BIT_TEST(valid, d)) {
+                printf("| index: %4x valid: %x dirty: %x tag: %8Lx ",
+                        j, (uint_t) BIT_TEST(valid, d), (uint_t) BIT_TEST(dirty, d),
+                        (ulong_t) cache->tag[j * cache->assoc + d]);
                 n = 1;
             }
         if (n==1) printf("|\n");
@@ -100,36 +274,371 @@ void cache_print_sets(cache_level cache)
 #endif
 
 /*
- * cache_hit: determines if the data for the address if located in the cache and
- * updates the cache hit count or miss count.
+ * match_scalar: compares the tags one at a time.
+ */
+ulong_t match_scalar(const addr_t *tags, addr_t tag, uint_t n)
+{
+    ulong_t m = 0;
+    uint_t j;
+
+    for (j=0; j<n; j++)
+        m |= (ulong_t) (tags[j] == tag) << j;
+    return m;
+}
+
+#ifdef CACHE_X86
+#ifdef ADDR64
+/*
+ * match_sse2: compares the tags two at a time with SSE2, which can only compare
+ * 32 bits at a time: a tag matches if both of its halves do.
+ */
+ulong_t match_sse2(const addr_t *tags, addr_t tag, uint_t n)
+{
+    const __m128i t = _mm_set1_epi64x(tag);
+    __m128i eq;
+    ulong_t m = 0;
+    uint_t j;
+
+    for (j=0; j<n; j+=2) {
+        eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (tags + j)), t);
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        m |= (ulong_t) _mm_movemask_pd(_mm_castsi128_pd(eq)) << j;
+    }
+    return n < 64 ? m & ((1ULL << n) - 1) : m;
+}
+
+/*
+ * match_avx2: compares the tags four at a time with AVX2.
+ */
+__attribute__((target("avx2")))
+ulong_t match_avx2(const addr_t *tags, addr_t tag, uint_t n)
+{
+    const __m256i t = _mm256_set1_epi64x(tag);
+    ulong_t m = 0;
+    uint_t j;
+
+    for (j=0; j<n; j+=4)
+        m |= (ulong_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(
+                    _mm256_loadu_si256((const __m256i *) (tags + j)), t))) << j;
+    return n < 64 ? m & ((1ULL << n) - 1) : m;
+}
+#else
+/*
+ * match_sse2: compares the tags four at a time with SSE2.
+ */
+ulong_t match_sse2(const addr_t *tags, addr_t tag, uint_t n)
+{
+    const __m128i t = _mm_set1_epi32(tag);
+    ulong_t m = 0;
+    uint_t j;
+
+    for (j=0; j<n; j+=4)
+        m |= (ulong_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+                    _mm_loadu_si128((const __m128i *) (tags + j)), t))) << j;
+    return n < 64 ? m & ((1ULL << n) - 1) : m;
+}
+
+/*
+ * match_avx2: compares the tags eight at a time with AVX2.
+ */
+__attribute__((target("avx2")))
+ulong_t match_avx2(const addr_t *tags, addr_t tag, uint_t n)
+{
+    const __m256i t = _mm256_set1_epi32(tag);
+    ulong_t m = 0;
+    uint_t j;
+
+    for (j=0; j<n; j+=8)
+        m |= (ulong_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+                    _mm256_loadu_si256((const __m256i *) (tags + j)), t))) << j;
+    return n < 64 ? m & ((1ULL << n) - 1) : m;
+}
+#endif
+#endif
+
+/*
+ * match_select: picks the best match kernel for a set of assoc ways.  Setting
+ * CACHESIM_SIMD to scalar, sse2 or avx2 overrides the choice.
+ */
+match_kernel match_select(uint_t assoc)
+{
+    const char *want = getenv("CACHESIM_SIMD");
+
+    // a vector doesn't pay for itself on one or two ways
+    if (assoc < 4 || (want && !strcmp(want, "scalar")))
+        return match_scalar;
+#ifdef CACHE_X86
+    __builtin_cpu_init();
+    if (assoc >= 8 && (!want || !strcmp(want, "avx2")) && __builtin_cpu_supports("avx2"))
+        return match_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return match_sse2;
+#endif
+    return match_scalar;
+}
+
+/*
+ * struct cache_arena: holds the blocks of every cache in one allocation.
+ */
+struct cache_arena {
+    char *base;
+    ulong_t size;
+};
+
+/*
+ * cache_carve: takes the next bytes of a cache's part of the arena, rounded up to
+ * CACHE_ALIGN.
  *
- * returns 1 for hit, 0 for miss
+ * returns where they start, or NULL if the layout is only being measured
+ */
+static inline void * cache_carve(char *p, ulong_t *used, ulong_t bytes)
+{
+    void *q = p ? p + *used : NULL;
+    *used += (bytes + CACHE_ALIGN - 1) & ~(ulong_t) (CACHE_ALIGN - 1);
+    return q;
+}
+
+/*
+ * cache_layout: lays out the blocks of a cache, and the hash table and LRU list
+ * of a fully associative one, in the zeroed memory at p.  If p is NULL the layout
+ * is only measured.
+ *
+ * NOTE: the tag array is padded so that a match kernel can read a whole vector
+ * past the last set.
+ *
+ * returns the number of bytes the cache takes
  */
-char cache_hit(cache_level cache, uint_t addr) 
+ulong_t cache_layout(cache_level cache, char *p)
 {
-    uint_t index, tag;
+    ulong_t blocks = (ulong_t) cache->sets_in_cache * cache->assoc;
+    ulong_t used = 0;
+    uint_t j, size;
+
+    cache->words_per_set = (cache->assoc + 63) / 64;
+    cache->tag = (addr_t *) cache_carve(p, &used, (blocks + MATCH_PAD) * sizeof(addr_t));
+    cache->stamp = (ulong_t *) cache_carve(p, &used, blocks * sizeof(ulong_t));
+    cache->valid = (ulong_t *) cache_carve(p, &used, cache->sets_in_cache * cache->words_per_set * sizeof(ulong_t));
+    cache->dirty = (ulong_t *) cache_carve(p, &used, cache->sets_in_cache * cache->words_per_set * sizeof(ulong_t));
+    cache->meta_words = (cache->assoc * cache->policy->meta_bits + 63) / 64;
+    cache->meta = (ulong_t *) cache_carve(p, &used, cache->sets_in_cache * cache->meta_words * sizeof(ulong_t));
+    if (cache->coherent) {
+        cache->shared = (ulong_t *) cache_carve(p, &used, cache->sets_in_cache * cache->words_per_set * sizeof(ulong_t));
+        cache->stale = (ulong_t *) cache_carve(p, &used, cache->sets_in_cache * cache->words_per_set * sizeof(ulong_t));
+    }
+    cache->table = NULL;
+
+    // fully associative caches look tags up in a hash table, kept at most half full
+    if (cache->sets_in_cache == 1) {
+        for (size=2; size<2*cache->assoc; size<<=1)
+            ;
+        cache->table = (struct cache_slot *) cache_carve(p, &used, size * sizeof(struct cache_slot));
+        cache->table_mask = size - 1;
+        cache->lru_prev = (uint_t *) cache_carve(p, &used, cache->assoc * sizeof(uint_t));
+        cache->lru_next = (uint_t *) cache_carve(p, &used, cache->assoc * sizeof(uint_t));
+    }
+
+    if (p != NULL) {
+        cache->match = match_select(cache->assoc);
+        cache->rand = CACHE_SEED;
+        cache->psel = (CACHE_PSEL + 1) / 2;
+
+        // never filled blocks are the oldest, in order of way
+        if (cache->table != NULL) {
+            for (j=0; j<cache->assoc; j++) {
+                cache->lru_prev[j] = j - 1;
+                cache->lru_next[j] = j + 1;
+            }
+            cache->lru_head = 0;
+            cache->lru_tail = cache->assoc - 1;
+        }
+    }
+    return used;
+}
+
+/*
+ * arena_alloc: allocates the blocks of n caches, once their geometry is known, in
+ * a single arena.  Big arenas are backed by huge pages where the system has them.
+ */
+void arena_alloc(struct cache_arena *arena, cache_level *caches, uint_t n)
+{
+    ulong_t used = 0;
     uint_t j;
-    struct cache_block d;
 
-    // calculate params
-    index = (addr / cache->block_size) % cache->sets_in_cache;
-    tag = addr >> (32 - cache->bits_in_tag);
-    
+    arena->size = 0;
+    for (j=0; j<n; j++)
+        arena->size += cache_layout(caches[j], NULL);
+#ifdef MADV_HUGEPAGE
+    if (arena->size >= ARENA_HUGEPAGE)
+        arena->size = (arena->size + ARENA_HUGEPAGE - 1) & ~(ulong_t) (ARENA_HUGEPAGE - 1);
+#endif
+
+    // anonymous memory comes zeroed
+    arena->base = (char *) mmap(NULL, arena->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (arena->base == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+#ifdef MADV_HUGEPAGE
+    if (arena->size >= ARENA_HUGEPAGE)
+        madvise(arena->base, arena->size, MADV_HUGEPAGE);   // only a hint
+#endif
+
+    for (j=0; j<n; j++)
+        used += cache_layout(caches[j], arena->base + used);
+}
+
+/*
+ * arena_free: frees the blocks of every cache in the arena.
+ */
+void arena_free(struct cache_arena *arena)
+{
+    munmap(arena->base, arena->size);
+}
+
+/*
+ * cache_slot_of: returns the slot of the hash table where the search for tag starts.
+ */
+static inline uint_t cache_slot_of(cache_level cache, addr_t tag)
+{
+    uint_t h = addr_fold(tag) * 0x9e3779b1u;
+    return (h ^ (h >> 16)) & cache->table_mask;
+}
+
+/*
+ * cache_find: looks a tag up in a fully associative cache.
+ *
+ * NOTE: only tag 0 can be held by more than one block (see cache_update), so
+ * the whole run of slots is searched for the least recently updated one.
+ *
+ * returns the way of the least recently updated valid block holding tag, or
+ * assoc if there is none
+ */
+static inline uint_t cache_find(cache_level cache, addr_t tag)
+{
+    struct cache_slot *table = cache->table;
+    ulong_t *stamp = cache->stamp;
+    uint_t j, way = cache->assoc;
+
+    for (j=cache_slot_of(cache, tag); table[j].way; j=(j+1) & cache->table_mask)
+        if (table[j].tag == tag && (way == cache->assoc || stamp[table[j].way-1] < stamp[way]))
+            way = table[j].way - 1;
+    return way;
+}
+
+/*
+ * cache_way: finds the block holding addr.
+ *
+ * returns its way, or assoc if it isn't in the cache
+ */
+uint_t cache_way(cache_level cache, addr_t addr)
+{
+    uint_t index = cache_index(cache, addr);
+    addr_t tag = cache_tag(cache, addr);
+    const addr_t *tags = cache->tag + index * cache->assoc;
+    const ulong_t *valid = cache->valid + index * cache->words_per_set;
+    ulong_t m;
+    uint_t j;
+
+    if (cache->table != NULL)
+        return cache_find(cache, tag);
+    for (j=0; j<cache->assoc; j+=64)
+        if ((m = cache->match(tags + j, tag, cache->assoc - j < 64 ? cache->assoc - j : 64) & valid[j >> 6]) != 0)
+            return j + __builtin_ctzll(m);
+    return cache->assoc;
+}
+
+/*
+ * cache_table_insert: records that way now holds tag.
+ */
+static inline void cache_table_insert(cache_level cache, addr_t tag, uint_t way)
+{
+    uint_t j;
+
+    for (j=cache_slot_of(cache, tag); cache->table[j].way; j=(j+1) & cache->table_mask)
+        ;
+    cache->table[j].tag = tag;
+    cache->table[j].way = way + 1;
+}
+
+/*
+ * cache_table_remove: forgets that way holds tag, shifting later slots of the run
+ * back so that no search stops short.
+ */
+static inline void cache_table_remove(cache_level cache, addr_t tag, uint_t way)
+{
+    struct cache_slot *table = cache->table;
+    uint_t mask = cache->table_mask;
+    uint_t j, k, home;
+
+    for (j=cache_slot_of(cache, tag); table[j].tag != tag || table[j].way != way + 1; j=(j+1) & mask)
+        ;
+    for (k=(j+1) & mask; table[k].way; k=(k+1) & mask) {
+        // a slot can fill the hole only if its search starts at or before the hole
+        home = cache_slot_of(cache, table[k].tag);
+        if (((k - home) & mask) >= ((k - j) & mask)) {
+            table[j] = table[k];
+            j = k;
+        }
+    }
+    table[j].way = 0;
+}
+
+/*
+ * cache_touch: moves a way to the most recently used end of the LRU list.
+ */
+static inline void cache_touch(cache_level cache, uint_t way)
+{
+    if (way == cache->lru_tail)
+        return;
+    if (way == cache->lru_head)
+        cache->lru_head = cache->lru_next[way];
+    else
+        cache->lru_next[cache->lru_prev[way]] = cache->lru_next[way];
+    cache->lru_prev[cache->lru_next[way]] = cache->lru_prev[way];
+
+    cache->lru_prev[way] = cache->lru_tail;
+    cache->lru_next[cache->lru_tail] = way;
+    cache->lru_tail = way;
+}
+
+/*
+ * cache_untouch: moves a way to the least recently used end of the LRU list.
+ */
+static inline void cache_untouch(cache_level cache, uint_t way)
+{
+    if (way == cache->lru_head)
+        return;
+    if (way == cache->lru_tail)
+        cache->lru_tail = cache->lru_prev[way];
+    else
+        cache->lru_prev[cache->lru_next[way]] = cache->lru_prev[way];
+    cache->lru_next[cache->lru_prev[way]] = cache->lru_next[way];
+
+    cache->lru_next[way] = cache->lru_head;
+    cache->lru_prev[cache->lru_head] = way;
+    cache->lru_head = way;
+}
+
+/*
+ * cache_count: updates the hit count or miss count, and the cycles, for a lookup
+ * of tag in set index.
+ *
+ * returns 1 for hit, 0 for miss
+ */
+static inline char cache_count(cache_level cache, uint_t index, addr_t tag, char hit, ulong_t *cycles)
+{
 #ifdef DEBUG 
-    printf("\tchecking index: %x for tag: %x... ", index, tag);
+    printf("\tchecking index: %x for tag: %Lx... ", index, (ulong_t) tag);
 #endif
 
-    // search set for correct valid tag
-    for (j=0; j<cache->assoc; j++) {
-        if (cache->set[index][j].valid && cache->set[index][j].tag == tag) {
-            cache->hit_count++;
-            *cycles += cache->hit_time;
+    if (hit) {
+        cache->hit_count++;
+        *cycles += cache->hit_time;
 #ifdef DEBUG
-            printf("HIT\n");
-            printf("\tcache hit time added (+%u)\n", cache->hit_time);
+        printf("HIT\n");
+        printf("\tcache hit time added (+%u)\n", cache->hit_time);
 #endif
-            return 1;
-        }
+        return 1;
     }
     cache->miss_count++;
     *cycles += cache->miss_time;
@@ -141,80 +650,166 @@ char cache_hit(cache_level cache, uint_t addr)
 }
 
 /*
- * void exchange(void *j, void *d, size_t size)
+ * cache_updated: reports an update when debugging.
+ */
+static inline void cache_updated(cache_level cache, uint_t index, addr_t tag, char dirty)
+{
+#ifdef DEBUG 
+    printf("\tset index: %x to tag: %Lx and dirty: %x\n", index, (ulong_t) tag, dirty);
+    cache_print_sets(cache);
+#endif
+}
+
+/*
+ * cache_hit: determines if the data for the address if located in the cache and
+ * updates the cache hit count or miss count.  The policy hears about a hit.
  *
- * This simply copies the number of bytes given by size from *j
- * to *d and from *d to *j.
+ * returns 1 for hit, 0 for miss
  */
-void exchange(void *j, void *d, size_t size)
+char cache_hit(cache_level cache, addr_t addr, ulong_t *cycles)
 {
-    char h;
-    size_t n;
-    for (n=0; n<size; n++) {
-        h = *(char*)(j+n);
-        *(char*)(j+n) = *(char*)(d+n);
-        *(char*)(d+n) = h;
+    uint_t index, j, way = 0;
+    addr_t tag;
+    char hit = 0;
+    const addr_t *tags;
+    const ulong_t *valid;
+    ulong_t m;
+
+    if (cache->engine != NULL)
+        return cache->engine->hit(cache, addr, cycles);
+
+    // calculate params
+    index = cache_index(cache, addr);
+    tag = cache_tag(cache, addr);
+
+    if (cache->table != NULL) {     // fully associative, look the tag up
+        hit = (way = cache_find(cache, tag)) < cache->assoc;
+    } else {                        // search set for correct valid tag, 64 ways at a time
+        tags = cache->tag + index * cache->assoc;
+        valid = cache->valid + index * cache->words_per_set;
+        for (j=0; j<cache->assoc && !hit; j+=64) {
+            m = cache->match(tags + j, tag, cache->assoc - j < 64 ? cache->assoc - j : 64) & valid[j >> 6];
+            if ((hit = m != 0))
+                way = j + __builtin_ctzll(m);
+        }
     }
+    cache->refs++;
+    if (hit && cache->policy->on_hit != NULL)
+        cache->policy->on_hit(cache, index, way);
+    return cache_count(cache, index, tag, hit, cycles);
 }
 
 /*
- * cache_prepare_block: moves a block to the front of the lru queue to be used next.
+ * cache_empty: finds the first never filled block in a set.
+ *
+ * returns the way of the block, or assoc if the set is full
  */
-void cache_prepare_block(cache_level cache, uint_t index, uint_t block)
+static inline uint_t cache_empty(cache_level cache, uint_t index)
 {
-    uint_t j;
+    const ulong_t *valid = cache->valid + index * cache->words_per_set;
+    uint_t j, way;
 
-    if (block == 0)
-        return;
+    for (j=0; j<cache->words_per_set; j++)
+        if (~valid[j]) {
+            way = (j << 6) + __builtin_ctzll(~valid[j]);
+            return way < cache->assoc ? way : cache->assoc;
+        }
+    return cache->assoc;
+}
 
-    for (j=block; j>0; j--) {
-        exchange(&cache->set[index][j], &cache->set[index][j-1], sizeof(struct cache_block *));
-    }
+/*
+ * cache_lru: finds the least recently updated block in a set.  This is the LRU
+ * policy's choose_victim.
+ *
+ * returns the way of the block
+ */
+uint_t cache_lru(cache_level cache, uint_t index)
+{
+    const ulong_t *stamp = cache->stamp + index * cache->assoc;
+    uint_t j, lru = 0;
+
+    if (cache->table != NULL)
+        return cache->lru_head;
+    for (j=1; j<cache->assoc; j++)
+        if (stamp[j] < stamp[lru])
+            lru = j;
+    return lru;
 }
 
 /*
- * cache_update: updates the contents of set with a LRU policy.
+ * cache_update: updates the contents of set, replacing a block if need be by the
+ * cache's policy.
  *
- * NOTE: cache->set[index] is an array of pointers.  thus, we can shift things
- * around such that cache->set[index][0] is always the LRU block in the set.
- * I call this the set priority queue in my notes.
+ * NOTE: the block written is the least recently updated block holding the tag
+ * already, or failing that the policy's victim.  Never filled blocks carry tag 0
+ * and the oldest stamp, so they count as holding tag 0.  The matching blocks come
+ * from the match kernel, or straight from the hash table of a fully associative
+ * cache, where a never filled block is taken first for tag 0.
  */
-void cache_update(cache_level cache, uint_t addr, char dirty)
+void cache_update(cache_level cache, addr_t addr, char dirty)
 {
-    uint_t index, tag, j;
+    uint_t index, j, way, match;
+    addr_t tag, *tags;
+    ulong_t *stamp, *valid, m;
+
+    if (cache->engine != NULL) {
+        cache->engine->update(cache, addr, dirty);
+        return;
+    }
 
     // calculate  useful params
-    index = (addr / cache->block_size) % cache->sets_in_cache;
-    tag = addr >> (32 - cache->bits_in_tag);
+    index = cache_index(cache, addr);
+    tag = cache_tag(cache, addr);
+    tags = cache->tag + index * cache->assoc;
+    stamp = cache->stamp + index * cache->assoc;
+    valid = cache->valid + index * cache->words_per_set;
  
     // we need to ensure that we do not write data that already exists in the cache
-    for (j=0; j<cache->assoc; j++) {
-        if (cache->set[index][j].tag == tag) {
-            cache_prepare_block(cache, index, j);
-            break;
+    if (cache->table != NULL) {
+        if (tag != 0 || (way = cache_empty(cache, index)) == cache->assoc)
+            way = cache_find(cache, tag);
+    } else {
+        way = cache->assoc;
+        for (j=0; j<cache->assoc; j+=64) {
+            m = cache->match(tags + j, tag, cache->assoc - j < 64 ? cache->assoc - j : 64);
+            for (; m; m &= m - 1) {
+                match = j + __builtin_ctzll(m);
+                if (way == cache->assoc || stamp[match] < stamp[way])
+                    way = match;
+            }
         }
     }
-
-    // update LRU block params
-    cache->set[index]->valid = 1;
-    cache->set[index]->dirty = dirty;
-    cache->set[index]->tag = tag;
-
-    // send the block we just updated to the back of the set priority queue
-    for (j=0; j<cache->assoc-1; j++) {
-        exchange(&cache->set[index][j], &cache->set[index][j+1], sizeof(struct cache_block *));
+    if (way == cache->assoc)
+        way = cache->policy->choose_victim(cache, index);
+
+    if (BIT_TEST(valid, way) && tags[way] == tag) {
+        if (cache->policy->on_update != NULL)
+            cache->policy->on_update(cache, index, way);
+    } else {
+        if (cache->table != NULL) {
+            if (BIT_TEST(valid, way))
+                cache_table_remove(cache, tags[way], way);
+            cache_table_insert(cache, tag, way);
+        }
+        cache->policy->on_fill(cache, index, way);
     }
 
-#ifdef DEBUG 
-    printf("\tset index: %x to tag: %x and dirty: %x\n", index, tag, dirty);
-    cache_print_sets(cache);
-#endif
+    // update block params
+    BIT_SET(valid, way);
+    if (dirty)
+        BIT_SET(cache->dirty + index * cache->words_per_set, way);
+    else
+        BIT_CLEAR(cache->dirty + index * cache->words_per_set, way);
+    tags[way] = tag;
+    stamp[way] = ++cache->clock;
+
+    cache_updated(cache, index, tag, dirty);
 }
 
 /*
  * cache_write: simply calls cache_update with the dirty bit set
  */
-void cache_write(cache_level cache, uint_t addr)
+void cache_write(cache_level cache, addr_t addr)
 {
     cache_update(cache, addr, DIRTY);
 }
@@ -222,7 +817,7 @@ void cache_write(cache_level cache, uint_t addr)
 /*
  * cache_read: simply calls cache_update without the dirty bit set
  */
-void cache_read(cache_level cache, uint_t addr)
+void cache_read(cache_level cache, addr_t addr)
 {
     cache_update(cache, addr, NODIRTY);
 }
@@ -231,7 +826,7 @@ void cache_read(cache_level cache, uint_t addr)
  * cache_transfer: handles data transfer between a lower level and a higher level
  * of cache.  It always goes in that direction.
  */
-void cache_transfer(cache_level l1, uint_t addr)
+void cache_transfer(cache_level l1, addr_t addr, ulong_t *cycles)
 {
     cache_level l2 = l1->next;
     uint_t trans_cycles;
@@ -257,16 +852,20 @@ void cache_transfer(cache_level l1, uint_t addr)
 /*
  * cache_kickout: handles data transfer between a higher level and a lower level
  * of cache.  It always goes in that direction.
+ *
+ * NOTE: a dirty block kicked out of the last level of cache is simply written
+ * back to main memory, which has nothing to look up or update.
  */
-void cache_kickout(cache_level l1, uint_t addr)
+void cache_kickout(cache_level l1, addr_t addr, ulong_t *cycles)
 {
     cache_level l2 = l1->next;
-    uint_t index;
+    uint_t index, lru;
 
-    index = (addr / l1->block_size) % l1->sets_in_cache;
+    index = cache_index(l1, addr);
+    lru = l1->policy->choose_victim(l1, index);
   
     // handle kickout
-    if (l1->set[index]->valid) {
+    if (BIT_TEST(l1->valid + index * l1->words_per_set, lru)) {
         l1->kickouts++;
 
 #ifdef DEBUG
@@ -274,22 +873,24 @@ void cache_kickout(cache_level l1, uint_t addr)
 #endif
 
     // handle dirty kickout
-    if (l1->set[index]->dirty) {
-        uint_t l1_addr;
+    if (BIT_TEST(l1->dirty + index * l1->words_per_set, lru)) {
+        addr_t l1_addr;
 
         l1->dirty_kickouts++;
 
 #ifdef DEBUG
         printf("\tupdated dirty kickouts\n");
 #endif
+        if (l2->next == NULL)
+            return;
         
         // reconsturct address of LRU block in l1 cache and send to l2 cache
-        l1_addr = (l1->set[index]->tag << (32 - l1->bits_in_tag)) + (index * l1->block_size);
+        l1_addr = (l1->tag[index * l1->assoc + lru] << l1->tag_shift) + ((addr_t) index * l1->block_size);
         
         // i honestly don't know why i need to do this, but it makes my code
         // match the output files we were given
-        if (cache_hit(l2, l1_addr)) {
-            cache_transfer(l1, l1_addr);
+        if (cache_hit(l2, l1_addr, cycles)) {
+            cache_transfer(l1, l1_addr, cycles);
             l1->transfers--;
             *cycles -= l1->hit_time;
         }
@@ -301,31 +902,38 @@ void cache_kickout(cache_level l1, uint_t addr)
 /*
  * cache_fetch: takes care of loading cache data in the caches and updates timing 
  * parameters accordingly. 
+ *
+ * NOTE: this walks down the hierarchy for as long as it misses, making room in
+ * each level on the way, then back up transferring the block into every level
+ * that missed, deepest first.
  */
-void cache_fetch(cache_level cache, uint_t addr, ulong_t * op_cycles)
+void cache_fetch(cache_level cache, addr_t addr, ulong_t *cycles)
 { 
+    cache_level missed[CACHE_LEVELS];
+    uint_t n = 0;
+
 #ifdef DEBUG 
-    printf("addr = %x\n", addr);
+    printf("addr = %Lx\n", (ulong_t) addr);
 #endif
-    
-    cycles = op_cycles;
-
-    if (!cache_hit(cache, addr)) {
-        cache_kickout(cache,  addr);
 
-        if (cache->next->next != NULL) 
-            cache_fetch(cache->next, addr, op_cycles);
-        
-        cache_transfer(cache, addr);
+    while (!cache_hit(cache, addr, cycles)) {
+        cache_kickout(cache, addr, cycles);
+        missed[n++] = cache;
+        if (cache->next->next == NULL)
+            break;
+        cache = cache->next;
     }
+
+    while (n > 0)
+        cache_transfer(missed[--n], addr, cycles);
 }
 
 /*
  * cache_store: handles all store requests to the cache
  */
-void cache_store(cache_level cache, uint_t addr, ulong_t * op_cycles)
+void cache_store(cache_level cache, addr_t addr, ulong_t *cycles)
 { 
-    cache_fetch(cache, addr, op_cycles);
+    cache_fetch(cache, addr, cycles);
     cache_write(cache, addr);
 }
 
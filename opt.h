@@ -0,0 +1,213 @@
+/*
+ * opt.h: implements the pass over the trace that Belady's OPT policy needs before
+ *        a simulation can start: when each reference's block is next used, for
+ *        every L1 cache given policy = "opt".
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#define OPT_ROOM        (1<<20)     // references an index starts out with room for
+#define OPT_INST        0           // streams: the instructions,
+#define OPT_DATA        1           // the loads and stores,
+#define OPT_BOTH        2           // and the two interleaved, for a unified L1
+
+/*
+ * struct opt_slot: implements an entry of the table of blocks seen so far.  last
+ * is stored plus one, so a zeroed slot is empty.
+ */
+struct opt_slot {
+    addr_t block;
+    uint_t last;
+};
+
+/*
+ * struct opt_index: holds the next use of every reference of one stream (the
+ * instructions, the loads and stores, or both for a unified L1) at one block size.
+ *
+ * NOTE: reference j of the stream is next used at reference next[j], or never if
+ * it is OPT_NEVER.  That is 4 bytes a reference, which is all the simulation
+ * keeps; the table of each block's last reference is only needed to build it.
+ */
+struct opt_index {
+    uint_t block_size;
+    char data;                  // OPT_INST, OPT_DATA or OPT_BOTH
+    uint_t *next;
+    ulong_t refs;
+    ulong_t room;
+
+    // the last reference to each block, in an open addressing hash table
+    struct opt_slot *table;
+    uint_t table_mask;
+    uint_t blocks;
+};
+
+/*
+ * opt_init: sets up the index of a stream of references to blocks of block_size
+ * bytes.
+ */
+void opt_init(struct opt_index *ix, uint_t block_size, char data)
+{
+    ix->block_size = block_size;
+    ix->data = data;
+    ix->room = OPT_ROOM;
+    ix->next = (uint_t *) ec_malloc(ix->room * sizeof(uint_t));
+    ix->refs = 0;
+    ix->table_mask = 1023;
+    ix->table = (struct opt_slot *) ec_malloc((ix->table_mask + 1) * sizeof(struct opt_slot));
+    ix->blocks = 0;
+}
+
+/*
+ * opt_free: frees what opt_init allocated.
+ */
+void opt_free(struct opt_index *ix)
+{
+    free(ix->next);
+    free(ix->table);
+}
+
+/*
+ * opt_slot: finds the slot of a block in the table, or the empty slot where it
+ * belongs.
+ */
+static inline struct opt_slot * opt_slot(struct opt_index *ix, addr_t block)
+{
+    uint_t h = addr_fold(block) * 0x9e3779b1u, j;
+
+    for (j=(h ^ (h >> 16)) & ix->table_mask; ix->table[j].last; j=(j+1) & ix->table_mask)
+        if (ix->table[j].block == block)
+            break;
+    return &ix->table[j];
+}
+
+/*
+ * opt_grow: doubles the table once it is half full.
+ */
+void opt_grow(struct opt_index *ix)
+{
+    struct opt_slot *old = ix->table;
+    uint_t j, n = ix->table_mask + 1;
+
+    ix->table_mask = 2 * n - 1;
+    ix->table = (struct opt_slot *) ec_malloc(2 * n * sizeof(struct opt_slot));
+    for (j=0; j<n; j++)
+        if (old[j].last)
+            *opt_slot(ix, old[j].block) = old[j];
+    free(old);
+}
+
+/*
+ * opt_add: records the next reference of the stream, which is to addr.
+ */
+void opt_add(struct opt_index *ix, addr_t addr)
+{
+    struct opt_slot *slot = opt_slot(ix, addr / ix->block_size);
+
+    if (ix->refs == OPT_NEVER) {
+        fprintf(stderr, "ERROR: opt can't follow more than %u references\n", OPT_NEVER - 1);
+        exit(EXIT_FAILURE);
+    }
+    if (ix->refs == ix->room) {
+        ix->room *= 2;
+        ix->next = (uint_t *) realloc(ix->next, ix->room * sizeof(uint_t));
+        if (ix->next == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // this is the next use of the block's last reference
+    if (slot->last) {
+        ix->next[slot->last - 1] = ix->refs;
+    } else {
+        slot->block = addr / ix->block_size;
+        if (++ix->blocks > (ix->table_mask + 1) / 2) {
+            slot->last = ix->refs + 1;
+            opt_grow(ix);
+            slot = opt_slot(ix, addr / ix->block_size);
+        }
+    }
+    ix->next[ix->refs] = OPT_NEVER;
+    slot->last = ++ix->refs;
+}
+
+/*
+ * opt_find: returns the index of the stream a cache sees among the n indexes so
+ * far, adding it if it isn't there yet.
+ */
+struct opt_index * opt_find(struct opt_index *ix, uint_t *n, cache_level cache, char data)
+{
+    uint_t j;
+
+    for (j=0; j<*n; j++)
+        if (ix[j].data == data && ix[j].block_size == cache->block_size)
+            return &ix[j];
+    opt_init(&ix[*n], cache->block_size, data);
+    return &ix[(*n)++];
+}
+
+/*
+ * opt_prepass: reads the whole trace to index the next uses every L1 cache with
+ * the OPT policy among the n simulations needs, and hands each its index.  Caches
+ * with the same block size share one.  The trace has to be rewound afterwards.
+ *
+ * returns the indexes, n of them, to be freed with opt_free once the simulations
+ * are through, or NULL if no cache needs one
+ */
+struct opt_index * opt_prepass(struct trace *t, struct cachesim *sims, uint_t nsims, uint_t *n)
+{
+    struct opt_index *ix, **want;
+    struct trace_batch *b;
+    uint_t j, k;
+
+    // at most one index for each L1 cache
+    ix = (struct opt_index *) ec_malloc(2 * nsims * sizeof(struct opt_index));
+    want = (struct opt_index **) ec_malloc(2 * nsims * sizeof(struct opt_index *));
+    *n = 0;
+    for (j=0; j<nsims; j++) {
+        if (sims[j].l1i == sims[j].l1d) {
+            if (sims[j].l1i->policy == &policy_opt)
+                want[2*j] = opt_find(ix, n, sims[j].l1i, OPT_BOTH);
+            continue;
+        }
+        if (sims[j].l1i->policy == &policy_opt)
+            want[2*j] = opt_find(ix, n, sims[j].l1i, OPT_INST);
+        if (sims[j].l1d->policy == &policy_opt)
+            want[2*j+1] = opt_find(ix, n, sims[j].l1d, OPT_DATA);
+    }
+    if (*n == 0) {
+        free(ix);
+        free(want);
+        return NULL;
+    }
+
+    // every record cachesim_simulate knows is an instruction reference
+    b = (struct trace_batch *) ec_malloc(sizeof(struct trace_batch));
+    do {
+        trace_read_batch(t, b);
+        for (j=0; j<b->n; j++) {
+            if (b->op[j] != 'L' && b->op[j] != 'S' && b->op[j] != 'B' && b->op[j] != 'C')
+                continue;
+            for (k=0; k<*n; k++) {
+                if (ix[k].data != OPT_DATA)
+                    opt_add(&ix[k], b->op_addr[j]);
+                if (ix[k].data != OPT_INST && (b->op[j] == 'L' || b->op[j] == 'S'))
+                    opt_add(&ix[k], b->byte_addr[j]);
+            }
+        }
+    } while (b->n == TRACE_BATCH);
+    free(b);
+
+    for (k=0; k<*n; k++) {
+        free(ix[k].table);
+        ix[k].table = NULL;
+    }
+    for (j=0; j<nsims; j++) {
+        if (sims[j].l1i->policy == &policy_opt)
+            sims[j].l1i->next_use = want[2*j]->next;
+        if (sims[j].l1d != sims[j].l1i && sims[j].l1d->policy == &policy_opt)
+            sims[j].l1d->next_use = want[2*j+1]->next;
+    }
+    free(want);
+    return ix;
+}
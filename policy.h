@@ -0,0 +1,402 @@
+/*
+ * policy.h: implements the replacement policies a cache can be given in the
+ *           settings: LRU, FIFO, random, tree pseudo-LRU, the RRIP family
+ *           (SRRIP, BRRIP and DRRIP) and Belady's OPT.  Each keeps at most two
+ *           bits per way of each set besides what every cache has, except for
+ *           OPT, which is a yardstick rather than something to build.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#include <strings.h>
+
+#define RRPV_NEAR       0           // re-reference predictions, 2 bits per way
+#define RRPV_LONG       2
+#define RRPV_DISTANT    3
+#define RRIP_LANES      0x5555555555555555ULL   // the low bit of every way in a word
+#define BRRIP_LONG      32          // one BRRIP fill in this many is long
+#define DRRIP_LEADERS   32          // sets that always use SRRIP, and as many BRRIP
+#define OPT_NEVER       (~0u)       // the next use of a block that isn't used again
+
+/*
+ * lru_touch: makes a block the most recently used.  The stamps that order the
+ * blocks of a set are kept by cache_update for every policy, so there is only
+ * the list of a fully associative cache to see to.
+ *
+ * NOTE: LRU has only ever counted updates as uses, not reads, so this is its
+ * on_update rather than its on_hit.
+ */
+void lru_touch(cache_level cache, uint_t index, uint_t way)
+{
+    if (cache->table != NULL)
+        cache_touch(cache, way);
+}
+
+/*
+ * fifo_fill: moves the set's next victim on past the block just filled.
+ *
+ * NOTE: the first word of the set's state holds the next way to replace.  Sets
+ * fill up in order of way, so it is also the first never filled block until
+ * the set is full, and goes round the ways after that.
+ */
+void fifo_fill(cache_level cache, uint_t index, uint_t way)
+{
+    cache->meta[index * cache->meta_words] = way + 1 == cache->assoc ? 0 : way + 1;
+}
+
+/*
+ * fifo_victim: returns a never filled (or invalidated) block, or failing that
+ * the block filled longest ago.
+ */
+uint_t fifo_victim(cache_level cache, uint_t index)
+{
+    uint_t way = cache_empty(cache, index);
+
+    if (way < cache->assoc)
+        return way;
+    return (uint_t) cache->meta[index * cache->meta_words];
+}
+
+/*
+ * policy_rand: moves the cache's generator on (xorshift64*).
+ *
+ * returns the next pseudo random number
+ */
+static inline uint_t policy_rand(cache_level cache)
+{
+    cache->rand ^= cache->rand >> 12;
+    cache->rand ^= cache->rand << 25;
+    cache->rand ^= cache->rand >> 27;
+    return (uint_t) ((cache->rand * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+/*
+ * random_fill: moves the generator on, so the next victim is a new pick.
+ */
+void random_fill(cache_level cache, uint_t index, uint_t way)
+{
+    policy_rand(cache);
+}
+
+/*
+ * random_victim: returns a never filled block, or failing that a block picked at
+ * random.
+ */
+uint_t random_victim(cache_level cache, uint_t index)
+{
+    uint_t way = cache_empty(cache, index);
+
+    if (way < cache->assoc)
+        return way;
+    return (uint_t) ((cache->rand * 0x2545f4914f6cdd1dULL) >> 32) % cache->assoc;
+}
+
+/*
+ * plru_touch: points the tree of the set away from a block.
+ *
+ * NOTE: the ways are the leaves of a binary tree, with a bit at each of its
+ * assoc - 1 inner nodes saying which half holds the next victim.  Node 1 is the
+ * root and node n has children 2n and 2n + 1, so node n is bit n of the set's
+ * state and leaf assoc + way is the block.  assoc must be a power of 2.
+ */
+void plru_touch(cache_level cache, uint_t index, uint_t way)
+{
+    ulong_t *bits = cache->meta + index * cache->meta_words;
+    uint_t node = 1, half;
+
+    for (half=cache->assoc>>1; half; half>>=1) {
+        if (way & half) {
+            BIT_CLEAR(bits, node);
+            node = 2 * node + 1;
+        } else {
+            BIT_SET(bits, node);
+            node = 2 * node;
+        }
+    }
+}
+
+/*
+ * plru_victim: returns a never filled block, or failing that the block the tree
+ * of the set points to.
+ */
+uint_t plru_victim(cache_level cache, uint_t index)
+{
+    const ulong_t *bits = cache->meta + index * cache->meta_words;
+    uint_t node, way = cache_empty(cache, index);
+
+    if (way < cache->assoc)
+        return way;
+    for (node=1; node<cache->assoc; )
+        node = 2 * node + BIT_TEST(bits, node);
+    return node - cache->assoc;
+}
+
+/*
+ * rrip_set: sets the re-reference prediction value (RRPV) of a block.
+ *
+ * NOTE: the RRPVs of a set are packed 32 to a word, way j in bits 2j and 2j + 1 of
+ * word j / 32 of the set's state, so a whole word of them is looked at at once.
+ */
+static inline void rrip_set(cache_level cache, uint_t index, uint_t way, ulong_t rrpv)
+{
+    ulong_t *w = cache->meta + index * cache->meta_words + (way >> 5);
+    uint_t shift = 2 * (way & 31);
+
+    *w = (*w & ~(3ULL << shift)) | (rrpv << shift);
+}
+
+/*
+ * rrip_lanes: returns the low bit of the RRPV of every way of a set that is in
+ * word j of its state.
+ */
+static inline ulong_t rrip_lanes(cache_level cache, uint_t j)
+{
+    uint_t n = cache->assoc - 32 * j;
+    return n >= 32 ? RRIP_LANES : RRIP_LANES & ((1ULL << (2 * n)) - 1);
+}
+
+/*
+ * rrip_hit: predicts a block that was used again, read or written, will be used
+ * again soon.
+ */
+void rrip_hit(cache_level cache, uint_t index, uint_t way)
+{
+    rrip_set(cache, index, way, RRPV_NEAR);
+}
+
+/*
+ * rrip_victim: returns a never filled block, or failing that the first block
+ * predicted to be used again in the distant future (RRPV 3).  If there is none,
+ * every block of the set is aged by as much as brings the oldest to 3 first.
+ */
+uint_t rrip_victim(cache_level cache, uint_t index)
+{
+    ulong_t *rrpv = cache->meta + index * cache->meta_words;
+    ulong_t m, high = 0, low = 0;
+    uint_t j, way = cache_empty(cache, index);
+
+    if (way < cache->assoc)
+        return way;
+
+    // a way is distant where both its bits are set
+    for (j=0; j<cache->meta_words; j++)
+        if ((m = rrpv[j] & (rrpv[j] >> 1) & rrip_lanes(cache, j)) != 0)
+            return 32 * j + __builtin_ctzll(m) / 2;
+
+    for (j=0; j<cache->meta_words; j++) {
+        high |= (rrpv[j] >> 1) & rrip_lanes(cache, j);
+        low |= rrpv[j] & rrip_lanes(cache, j);
+    }
+    m = high ? 1 : low ? 2 : 3;     // no way overflows, as none is at 3
+    for (j=0; j<cache->meta_words; j++)
+        rrpv[j] += m * rrip_lanes(cache, j);
+    cache->agings++;
+
+    for (j=0; ; j++)
+        if ((m = rrpv[j] & (rrpv[j] >> 1) & rrip_lanes(cache, j)) != 0)
+            return 32 * j + __builtin_ctzll(m) / 2;
+}
+
+/*
+ * srrip_fill: predicts a new block will be used again, but not soon (RRPV 2), so
+ * that a scan of blocks used once goes before the blocks that were used again.
+ */
+void srrip_fill(cache_level cache, uint_t index, uint_t way)
+{
+    rrip_set(cache, index, way, RRPV_LONG);
+    cache->long_fills++;
+}
+
+/*
+ * brrip_fill: predicts most new blocks won't be used again (RRPV 3), so that a
+ * working set too big for the cache keeps part of itself in it.  One in
+ * BRRIP_LONG, at random, is filled as SRRIP would.
+ */
+void brrip_fill(cache_level cache, uint_t index, uint_t way)
+{
+    if (policy_rand(cache) % BRRIP_LONG == 0) {
+        srrip_fill(cache, index, way);
+        return;
+    }
+    rrip_set(cache, index, way, RRPV_DISTANT);
+    cache->distant_fills++;
+}
+
+/*
+ * drrip_fill: fills as SRRIP or BRRIP, whichever misses less, by set dueling.
+ *
+ * NOTE: DRRIP_LEADERS sets spread over the cache always fill as SRRIP, as many
+ * others always fill as BRRIP, and every fill (a miss) in one of them moves the
+ * counter psel towards the other.  The rest of the sets follow whichever side
+ * psel leans to.
+ */
+void drrip_fill(cache_level cache, uint_t index, uint_t way)
+{
+    uint_t stride = cache->sets_in_cache / DRRIP_LEADERS;
+
+    if (stride < 2)
+        stride = 2;
+    if (index % stride == 0) {              // SRRIP leader
+        if (cache->psel < CACHE_PSEL)
+            cache->psel++;
+        srrip_fill(cache, index, way);
+    } else if (index % stride == stride / 2) {  // BRRIP leader
+        if (cache->psel > 0)
+            cache->psel--;
+        brrip_fill(cache, index, way);
+    } else if (cache->psel > CACHE_PSEL / 2) {
+        brrip_fill(cache, index, way);
+    } else {
+        srrip_fill(cache, index, way);
+    }
+}
+
+/*
+ * rrip_stats: writes the RRIP policies' line of the report.
+ */
+void rrip_stats(cache_level cache, char *line, uint_t size)
+{
+    int n = snprintf(line, size, "\tLong Fills : %Lu Distant Fills : %Lu Agings : %Lu",
+            cache->long_fills, cache->distant_fills, cache->agings);
+
+    if (n >= 0 && (uint_t) n < size && cache->policy->on_fill == drrip_fill)
+        n += snprintf(line + n, size - n, " PSEL : %u (%s)", cache->psel,
+                cache->psel > CACHE_PSEL / 2 ? "brrip" : "srrip");
+    if (n >= 0 && (uint_t) n < size)
+        snprintf(line + n, size - n, "\n");
+}
+
+/*
+ * opt_keys: returns the state of a set for OPT.
+ *
+ * NOTE: the state is three arrays of assoc words: the next use of each way, a
+ * max-heap of the filled ways ordered by next use, and where each way is in the
+ * heap.  Keeping them up to date takes O(log assoc) per reference, and the
+ * victim is always at the top of the heap.
+ */
+static inline uint_t * opt_keys(cache_level cache, uint_t index)
+{
+    return (uint_t *) (cache->meta + index * cache->meta_words);
+}
+
+/*
+ * opt_filled: returns the number of blocks of a set that have been filled, which
+ * is the size of its heap.
+ */
+static inline uint_t opt_filled(cache_level cache, uint_t index)
+{
+    const ulong_t *valid = cache->valid + index * cache->words_per_set;
+    uint_t j, n = 0;
+
+    for (j=0; j<cache->words_per_set; j++)
+        n += __builtin_popcountll(valid[j]);
+    return n;
+}
+
+/*
+ * opt_sift: moves the way at position j of a heap of n ways up or down to where
+ * its next use puts it.
+ */
+void opt_sift(const uint_t *key, uint_t *heap, uint_t *pos, uint_t j, uint_t n)
+{
+    uint_t way = heap[j], k;
+
+    while (j > 0 && key[heap[(j - 1) / 2]] < key[way]) {
+        heap[j] = heap[(j - 1) / 2];
+        pos[heap[j]] = j;
+        j = (j - 1) / 2;
+    }
+    while ((k = 2 * j + 1) < n) {
+        if (k + 1 < n && key[heap[k + 1]] > key[heap[k]])
+            k++;
+        if (key[heap[k]] <= key[way])
+            break;
+        heap[j] = heap[k];
+        pos[heap[j]] = j;
+        j = k;
+    }
+    heap[j] = way;
+    pos[way] = j;
+}
+
+/*
+ * opt_next: returns when the block of the reference being made is next used.
+ */
+static inline uint_t opt_next(cache_level cache)
+{
+    if (cache->next_use == NULL) {
+        fprintf(stderr, "ERROR: opt needs the next use of every reference (see opt_prepass)\n");
+        exit(EXIT_FAILURE);
+    }
+    return cache->next_use[cache->refs - 1];
+}
+
+/*
+ * opt_fill: gives a new block the next use of the reference that brought it in.
+ */
+void opt_fill(cache_level cache, uint_t index, uint_t way)
+{
+    uint_t *key = opt_keys(cache, index), *heap = key + cache->assoc, *pos = heap + cache->assoc;
+    uint_t n = opt_filled(cache, index);
+
+    key[way] = opt_next(cache);
+    if (!BIT_TEST(cache->valid + index * cache->words_per_set, way)) {
+        heap[n] = way;
+        opt_sift(key, heap, pos, n, n + 1);
+    } else {
+        opt_sift(key, heap, pos, pos[way], n);
+    }
+}
+
+/*
+ * opt_hit: moves the block just referenced on to its next use.
+ */
+void opt_hit(cache_level cache, uint_t index, uint_t way)
+{
+    uint_t *key = opt_keys(cache, index), *heap = key + cache->assoc, *pos = heap + cache->assoc;
+
+    key[way] = opt_next(cache);
+    opt_sift(key, heap, pos, pos[way], opt_filled(cache, index));
+}
+
+/*
+ * opt_victim: returns a never filled block, or failing that the block used again
+ * furthest in the future.
+ */
+uint_t opt_victim(cache_level cache, uint_t index)
+{
+    uint_t way = cache_empty(cache, index);
+
+    if (way < cache->assoc)
+        return way;
+    return opt_keys(cache, index)[cache->assoc];
+}
+
+const struct cache_policy policy_lru = { "lru", 0, NULL, lru_touch, lru_touch, cache_lru, NULL };
+const struct cache_policy policy_fifo = { "fifo", 1, NULL, fifo_fill, NULL, fifo_victim, NULL };
+const struct cache_policy policy_random = { "random", 0, NULL, random_fill, NULL, random_victim, NULL };
+const struct cache_policy policy_plru = { "plru", 1, plru_touch, plru_touch, NULL, plru_victim, NULL };
+const struct cache_policy policy_srrip = { "srrip", 2, rrip_hit, srrip_fill, NULL, rrip_victim, rrip_stats };
+const struct cache_policy policy_brrip = { "brrip", 2, rrip_hit, brrip_fill, NULL, rrip_victim, rrip_stats };
+const struct cache_policy policy_drrip = { "drrip", 2, rrip_hit, drrip_fill, NULL, rrip_victim, rrip_stats };
+const struct cache_policy policy_opt = { "opt", 3 * 32, opt_hit, opt_fill, NULL, opt_victim, NULL };
+
+static const struct cache_policy * const policies[] = {
+    &policy_lru, &policy_fifo, &policy_random, &policy_plru,
+    &policy_srrip, &policy_brrip, &policy_drrip, &policy_opt
+};
+
+/*
+ * policy_select: looks a policy up by name, ignoring case.
+ *
+ * returns the policy, or NULL if there is none by that name
+ */
+const struct cache_policy * policy_select(const char *name)
+{
+    uint_t j;
+
+    for (j=0; j<sizeof(policies)/sizeof(policies[0]); j++)
+        if (!strcasecmp(policies[j]->name, name))
+            return policies[j];
+    return NULL;
+}
@@ -0,0 +1,255 @@
+/*
+ * pool.h: implements the parallel sweep.  The trace is decoded a window of
+ *         batches at a time, and while the main thread decodes the next window
+ *         a pool of worker threads runs every simulation over the current one.
+ *         The simulations are shared out between the workers by work stealing.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define POOL_WINDOW     64          // batches in a window
+
+/*
+ * struct deque: holds the simulations a worker has yet to run over the window.
+ *
+ * NOTE: this is a Chase-Lev deque cut down to what the sweep needs.  Every task
+ * is in place before the workers are started on a window, so it never grows.
+ * The owner takes tasks from the bottom and thieves take them from the top; they
+ * only race for the last one, which is settled by a compare and swap on top.
+ */
+struct deque {
+    _Alignas(64) atomic_int top;
+    _Alignas(64) atomic_int bottom;
+    _Alignas(64) uint_t *task;
+    int size;
+};
+
+/*
+ * struct worker: implements one thread of the pool.
+ */
+struct worker {
+    struct deque deque;
+    struct pool *pool;
+    uint_t id;
+    pthread_t thread;
+};
+
+/*
+ * struct pool: implements the pool of workers and the window they work on.
+ */
+struct pool {
+    struct cachesim *sims;
+    struct worker *worker;
+    uint_t nworkers;
+
+    // the window being simulated
+    struct trace_batch *window;
+    uint_t nbatches;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;       // a window is ready, or the pool is stopping
+    pthread_cond_t done;        // every worker is through with the window
+    uint_t round;               // counts the windows handed out
+    uint_t busy;                // workers still on this round's window
+    char stop;
+};
+
+/*
+ * deque_pop: takes a task from the bottom of a worker's own deque.
+ *
+ * returns the task, or -1 if the deque is empty
+ */
+int deque_pop(struct deque *d)
+{
+    int b = atomic_load(&d->bottom) - 1, t, task;
+
+    atomic_store(&d->bottom, b);
+    t = atomic_load(&d->top);
+    if (t > b) {                // empty
+        atomic_store(&d->bottom, b + 1);
+        return -1;
+    }
+    task = d->task[b];
+    if (t == b) {               // the last task, which a thief may be taking too
+        if (!atomic_compare_exchange_strong(&d->top, &t, t + 1))
+            task = -1;
+        atomic_store(&d->bottom, b + 1);
+    }
+    return task;
+}
+
+/*
+ * deque_steal: takes a task from the top of another worker's deque.
+ *
+ * returns the task, or -1 if the deque is empty
+ */
+int deque_steal(struct deque *d)
+{
+    int t = atomic_load(&d->top), b;
+
+    while (t < (b = atomic_load(&d->bottom))) {
+        if (atomic_compare_exchange_strong(&d->top, &t, t + 1))
+            return d->task[t];
+        // lost the race for it; t now holds the new top
+    }
+    return -1;
+}
+
+/*
+ * pool_steal: looks through the other workers' deques for a task.
+ *
+ * returns the task, or -1 if there is nothing left to do
+ */
+int pool_steal(struct pool *p, struct worker *w)
+{
+    uint_t j;
+    int task;
+
+    for (j=1; j<p->nworkers; j++)
+        if ((task = deque_steal(&p->worker[(w->id + j) % p->nworkers].deque)) >= 0)
+            return task;
+    return -1;
+}
+
+/*
+ * pool_work: the body of a worker thread.
+ */
+void * pool_work(void *arg)
+{
+    struct worker *w = (struct worker *) arg;
+    struct pool *p = w->pool;
+    struct trace_batch *b;
+    uint_t round = 0, j, k;
+    int task;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (p->round == round && !p->stop)
+            pthread_cond_wait(&p->start, &p->lock);
+        if (p->stop) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        round = p->round;
+        pthread_mutex_unlock(&p->lock);
+
+        // run our own simulations over the window, then help the others
+        while ((task = deque_pop(&w->deque)) >= 0 || (task = pool_steal(p, w)) >= 0)
+            for (k=0; k<p->nbatches; k++)
+                for (b=&p->window[k], j=0; j<b->n; j++)
+                    cachesim_simulate(&p->sims[task], b->core[j], b->op[j], b->op_addr[j], b->byte_addr[j]);
+
+        pthread_mutex_lock(&p->lock);
+        if (--p->busy == 0)
+            pthread_cond_signal(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/*
+ * pool_start: starts n workers for the simulations in sims.
+ *
+ * NOTE: simulation k always starts out in the deque of worker k % n, so unless it
+ * is stolen it runs on the same thread, and in the same cache, every window.
+ */
+void pool_start(struct pool *p, struct cachesim *sims, uint_t nsims, uint_t n)
+{
+    struct worker *w;
+    uint_t j, k;
+
+    p->sims = sims;
+    p->nworkers = n;
+    p->worker = (struct worker *) ec_malloc(n * sizeof(struct worker));
+    p->round = p->busy = 0;
+    p->stop = 0;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    for (j=0; j<n; j++) {
+        w = &p->worker[j];
+        w->pool = p;
+        w->id = j;
+        w->deque.task = (uint_t *) ec_malloc((nsims / n + 1) * sizeof(uint_t));
+        for (k=j; k<nsims; k+=n)
+            w->deque.task[w->deque.size++] = k;
+        atomic_init(&w->deque.top, 0);
+        atomic_init(&w->deque.bottom, 0);
+
+        if ((errno = pthread_create(&w->thread, NULL, pool_work, w)) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*
+ * pool_run: starts the workers on a window of n batches.
+ */
+void pool_run(struct pool *p, struct trace_batch *window, uint_t n)
+{
+    uint_t j;
+
+    pthread_mutex_lock(&p->lock);
+    p->window = window;
+    p->nbatches = n;
+    for (j=0; j<p->nworkers; j++) {
+        atomic_store(&p->worker[j].deque.top, 0);
+        atomic_store(&p->worker[j].deque.bottom, p->worker[j].deque.size);
+    }
+    p->busy = p->nworkers;
+    p->round++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * pool_wait: waits for the workers to finish the window.
+ */
+void pool_wait(struct pool *p)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->busy > 0)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * pool_stop: stops the workers and frees the pool.
+ */
+void pool_stop(struct pool *p)
+{
+    uint_t j;
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+
+    for (j=0; j<p->nworkers; j++) {
+        pthread_join(p->worker[j].thread, NULL);
+        free(p->worker[j].deque.task);
+    }
+    free(p->worker);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->start);
+    pthread_cond_destroy(&p->done);
+}
+
+/*
+ * pool_read: decodes the next window of the trace.
+ *
+ * returns the number of batches read, the last of which is not full at the end of
+ * the trace
+ */
+uint_t pool_read(struct trace *t, struct trace_batch *window)
+{
+    uint_t n = 0;
+
+    while (n < POOL_WINDOW && trace_read_batch(t, &window[n++]) == TRACE_BATCH)
+        ;
+    return n;
+}
@@ -0,0 +1,120 @@
+/*
+ * ring.h: implements the pipelined trace reader.  A parser thread decodes the
+ *         trace into batches of records and hands them to the simulation
+ *         thread through a single-producer/single-consumer ring.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define RING_SIZE       8           // batches in the ring (a power of 2)
+#define RING_SPINS      1024        // polls before a waiting thread yields
+
+/*
+ * struct ring: the queue of batches between the parser and the simulator.
+ *
+ * NOTE: head and tail count batches forever and are only ever written by one
+ * side each (head by the parser, tail by the simulator), so no locks are needed,
+ * only acquire/release ordering.  They sit on their own cache lines so the two
+ * threads don't fight over them.  A batch that isn't full is the last one.
+ */
+struct ring {
+    _Alignas(64) atomic_uint head;      // next batch the parser fills
+    _Alignas(64) atomic_uint tail;      // next batch the simulator reads
+    _Alignas(64) struct trace_batch *batch;
+    struct trace *trace;
+    pthread_t thread;
+    char last;                          // the simulator has the final batch
+};
+
+/*
+ * ring_wait: backs off while the other side of the ring catches up.
+ */
+static inline void ring_wait(uint_t *spins)
+{
+    if (++*spins >= RING_SPINS) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+/*
+ * ring_parser: the body of the parser thread.
+ */
+void * ring_parser(void *arg)
+{
+    struct ring *r = (struct ring *) arg;
+    uint_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint_t spins = 0, n;
+
+    do {
+        // wait for the simulator to free up a batch
+        while (head - atomic_load_explicit(&r->tail, memory_order_acquire) == RING_SIZE)
+            ring_wait(&spins);
+
+        n = trace_read_batch(r->trace, &r->batch[head % RING_SIZE]);
+        atomic_store_explicit(&r->head, ++head, memory_order_release);
+    } while (n == TRACE_BATCH);
+
+    return NULL;
+}
+
+/*
+ * ring_start: allocates the ring and starts parsing the trace on its own thread.
+ */
+void ring_start(struct ring *r, struct trace *t)
+{
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->last = 0;
+    r->batch = (struct trace_batch *) ec_malloc(RING_SIZE * sizeof(struct trace_batch));
+    r->trace = t;
+
+    if ((errno = pthread_create(&r->thread, NULL, ring_parser, r)) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * ring_next: waits for the parser to finish the next batch.
+ *
+ * returns the batch, or NULL once the whole trace has been handed over
+ */
+struct trace_batch * ring_next(struct ring *r)
+{
+    uint_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint_t spins = 0;
+    struct trace_batch *b;
+
+    if (r->last)
+        return NULL;
+
+    while (atomic_load_explicit(&r->head, memory_order_acquire) == tail)
+        ring_wait(&spins);
+
+    b = &r->batch[tail % RING_SIZE];
+    r->last = b->n < TRACE_BATCH;
+    return b;
+}
+
+/*
+ * ring_release: hands the batch returned by ring_next back to the parser.
+ */
+void ring_release(struct ring *r)
+{
+    uint_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+/*
+ * ring_stop: waits for the parser thread and frees the ring.
+ */
+void ring_stop(struct ring *r)
+{
+    pthread_join(r->thread, NULL);
+    free(r->batch);
+}
@@ -0,0 +1,230 @@
+/*
+ * stackdist.h: implements stack distance analysis.  One pass over the trace gives
+ *              the miss rate of a fully associative LRU cache of every size at
+ *              once (Mattson et al.), instead of one simulation per size.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#define STACKDIST_TIMES (1<<20)     // times the tree starts out with room for
+
+/*
+ * struct stackdist_slot: implements an entry of the table of blocks seen so far.
+ * time is 0 for an empty slot.
+ */
+struct stackdist_slot {
+    addr_t block;
+    uint_t time;
+};
+
+/*
+ * struct stackdist: holds the stack distance analysis of one stream of references.
+ *
+ * NOTE: every reference is stamped with a time, and each block seen so far keeps
+ * a mark in a Fenwick tree at the time of its last reference.  The stack distance
+ * of a reference, the number of other blocks used since the block's last
+ * reference, is then the number of marks after that time, which the tree counts
+ * in O(log n).  When the times run out they are renumbered in order, one per
+ * block, so the tree only ever needs to be a few times the number of blocks.
+ */
+struct stackdist {
+    uint_t block_size;
+
+    // the last reference to each block, in an open addressing hash table
+    struct stackdist_slot *table;
+    uint_t table_mask;
+    uint_t blocks;
+
+    // Fenwick tree over times 1 to size
+    uint_t *tree;
+    uint_t size;
+    uint_t now;
+
+    // hist[d] counts references at stack distance d
+    ulong_t *hist;
+    ulong_t refs;
+    ulong_t cold;
+};
+
+/*
+ * stackdist_init: sets up the analysis of a stream of references to blocks of
+ * block_size bytes.
+ */
+void stackdist_init(struct stackdist *sd, uint_t block_size)
+{
+    sd->block_size = block_size;
+    sd->table_mask = 1023;
+    sd->table = (struct stackdist_slot *) ec_malloc((sd->table_mask + 1) * sizeof(struct stackdist_slot));
+    sd->blocks = 0;
+    sd->size = STACKDIST_TIMES;
+    sd->tree = (uint_t *) ec_malloc((sd->size + 1) * sizeof(uint_t));
+    sd->now = 0;
+    sd->hist = (ulong_t *) ec_malloc((sd->table_mask + 1) * sizeof(ulong_t));
+    sd->refs = sd->cold = 0;
+}
+
+/*
+ * stackdist_free: frees what stackdist_init allocated.
+ */
+void stackdist_free(struct stackdist *sd)
+{
+    free(sd->table);
+    free(sd->tree);
+    free(sd->hist);
+}
+
+/*
+ * stackdist_add: adds v to the count at time t.
+ */
+static inline void stackdist_add(struct stackdist *sd, uint_t t, int v)
+{
+    for (; t<=sd->size; t+=t&-t)
+        sd->tree[t] += v;
+}
+
+/*
+ * stackdist_count: returns the number of marks at times 1 to t.
+ */
+static inline uint_t stackdist_count(struct stackdist *sd, uint_t t)
+{
+    uint_t n = 0;
+
+    for (; t>0; t-=t&-t)
+        n += sd->tree[t];
+    return n;
+}
+
+/*
+ * stackdist_slot: finds the slot of a block in the table, or the empty slot where
+ * it belongs.
+ */
+static inline struct stackdist_slot * stackdist_slot(struct stackdist *sd, addr_t block)
+{
+    uint_t h = addr_fold(block) * 0x9e3779b1u, j;
+
+    for (j=(h ^ (h >> 16)) & sd->table_mask; sd->table[j].time; j=(j+1) & sd->table_mask)
+        if (sd->table[j].block == block)
+            break;
+    return &sd->table[j];
+}
+
+/*
+ * stackdist_grow: doubles the table (and the histogram with it) once it is half full.
+ */
+void stackdist_grow(struct stackdist *sd)
+{
+    struct stackdist_slot *old = sd->table;
+    uint_t j, n = sd->table_mask + 1;
+
+    sd->table_mask = 2 * n - 1;
+    sd->table = (struct stackdist_slot *) ec_malloc(2 * n * sizeof(struct stackdist_slot));
+    for (j=0; j<n; j++)
+        if (old[j].time)
+            *stackdist_slot(sd, old[j].block) = old[j];
+    free(old);
+
+    sd->hist = (ulong_t *) realloc(sd->hist, 2 * n * sizeof(ulong_t));
+    if (sd->hist == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(sd->hist + n, 0, n * sizeof(ulong_t));
+}
+
+/*
+ * stackdist_cmp: orders slots by time for qsort.
+ */
+int stackdist_cmp(const void *a, const void *b)
+{
+    uint_t x = (*(struct stackdist_slot **) a)->time, y = (*(struct stackdist_slot **) b)->time;
+    return (x > y) - (x < y);
+}
+
+/*
+ * stackdist_renumber: gives the blocks the times 1 to blocks, keeping their order,
+ * and makes sure the tree has room for at least as many times again.
+ */
+void stackdist_renumber(struct stackdist *sd)
+{
+    struct stackdist_slot **live;
+    uint_t j, n = 0;
+
+    live = (struct stackdist_slot **) ec_malloc(sd->blocks * sizeof(struct stackdist_slot *));
+    for (j=0; j<=sd->table_mask; j++)
+        if (sd->table[j].time)
+            live[n++] = &sd->table[j];
+    qsort(live, n, sizeof(struct stackdist_slot *), stackdist_cmp);
+    for (j=0; j<n; j++)
+        live[j]->time = j + 1;
+    free(live);
+
+    if (sd->size < 2 * n) {
+        sd->size = 2 * n;
+        free(sd->tree);
+        sd->tree = (uint_t *) ec_malloc((sd->size + 1) * sizeof(uint_t));
+    }
+
+    // a mark at each of times 1 to n, built in place in O(size)
+    memset(sd->tree, 0, (sd->size + 1) * sizeof(uint_t));
+    for (j=1; j<=sd->size; j++) {
+        sd->tree[j] += (j <= n);
+        if (j + (j & -j) <= sd->size)
+            sd->tree[j + (j & -j)] += sd->tree[j];
+    }
+    sd->now = n;
+}
+
+/*
+ * stackdist_ref: records a reference to addr.
+ */
+void stackdist_ref(struct stackdist *sd, addr_t addr)
+{
+    struct stackdist_slot *slot = stackdist_slot(sd, addr / sd->block_size);
+
+    sd->refs++;
+    if (sd->now == sd->size)
+        stackdist_renumber(sd);
+    sd->now++;
+
+    if (slot->time) {
+        sd->hist[stackdist_count(sd, sd->now - 1) - stackdist_count(sd, slot->time)]++;
+        stackdist_add(sd, slot->time, -1);
+    } else {
+        sd->cold++;
+        slot->block = addr / sd->block_size;
+        if (++sd->blocks > (sd->table_mask + 1) / 2) {
+            slot->time = sd->now;
+            stackdist_grow(sd);
+            slot = stackdist_slot(sd, addr / sd->block_size);
+        }
+    }
+    slot->time = sd->now;
+    stackdist_add(sd, sd->now, 1);
+}
+
+/*
+ * stackdist_report: prints the miss rate of every power of 2 cache size, from one
+ * block until the whole stream fits.
+ */
+void stackdist_report(struct stackdist *sd, const char *name)
+{
+    ulong_t misses = sd->refs - sd->cold, size;
+    uint_t d = 0;
+
+    printf("\
+Memory Level: %s\n\
+\tReferences = %Lu\tBlocks = %u\tCold Misses = %Lu\n\
+\t%12s   %s\n",
+        name, sd->refs, sd->blocks, sd->cold, "Cache Size", "Miss Rate");
+
+    // misses counts the non-cold references at a distance of at least size blocks
+    for (size=1; ; size*=2) {
+        for (; d<size && d<sd->blocks; d++)
+            misses -= sd->hist[d];
+        printf("\t%12Lu   %.2f%%\n", size * sd->block_size,
+                sd->refs ? (double) (misses + sd->cold) / sd->refs * 100 : 0.0);
+        if (size >= sd->blocks)
+            break;
+    }
+    printf("\n");
+}
@@ -0,0 +1,510 @@
+/*
+ * trace.h: implements trace ingestion for the simulator.  Trace records are
+ *          parsed by hand straight out of memory instead of through scanf.
+ *          Both the text traces and our binary trace format are understood,
+ *          and either may be gzip, xz or zstd compressed.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "zstream.h"
+
+#define TRACE_BUFSIZE   (1 << 22)   // size of the streaming buffers
+#define TRACE_MAXLINE   128         // longest record we guarantee to parse
+
+#define TRACE_MAGIC     "CSIMTRC"   // first 7 bytes of a binary trace
+#define TRACE_VERSION   2           // newest binary format we understand
+
+// trace encodings
+#define TRACE_TEXT      0           // "op op_addr byte_addr" lines
+#define TRACE_FIXED     1           // op byte followed by two fixed-width addresses
+#define TRACE_VARINT    2           // zigzag varint deltas (version 2)
+
+#define TRACE_OPS       "LSBC"      // op codes of a TRACE_VARINT record
+#define TRACE_OP_WIDE   6           // op code meaning the op byte and the op_addr delta follow
+#define TRACE_OP_RAW    7           // op code meaning the op byte follows
+
+/*
+ * struct trace_header: starts every binary trace.  Addresses are stored little
+ * endian and addr_bytes wide (4 or 8).  Wider addresses are truncated to an addr_t
+ * when read.
+ *
+ * NOTE: a TRACE_VARINT record is two varints (little endian base 128).  The
+ * first holds the difference from the previous op_addr, zigzag encoded so small
+ * negative steps stay small, shifted up over a 3 bit op code (TRACE_OPS, or
+ * TRACE_OP_RAW with the op byte following).  The second holds the byte_addr of a
+ * load or store as a zigzag encoded difference from the previous load or store
+ * address, and anything else (branch outcome, compute latency) as is.  The common
+ * "next instruction" record therefore takes a single byte for op and op_addr.
+ * A 64 bit op_addr delta too big to shift over the op code is written with
+ * TRACE_OP_WIDE instead: the op byte follows, then the delta in a varint of its
+ * own.
+ */
+struct trace_header {
+    char magic[7];
+    unsigned char version;
+    unsigned char encoding;
+    unsigned char addr_bytes;
+    unsigned char reserved[6];
+};
+
+/*
+ * struct trace: holds the state of an input trace.
+ *
+ * NOTE: if the trace is a regular file we simply map the whole thing and walk
+ * pos from one end to the other.  Pipes can't be mapped, so in that case buf is
+ * a heap buffer that trace_refill() keeps topped off with read().  Compressed
+ * traces are always parsed out of a heap buffer; the compressed bytes come from
+ * the mapping when there is one, or from zbuf otherwise.
+ */
+struct trace {
+    int fd;
+    char *buf;          // start of the bytes being parsed
+    char *pos;          // next byte to parse
+    char *end;          // one past the last valid byte
+    char eof;           // set once no more bytes can be parsed into buf
+    char *map;          // the mapped file, or NULL when streaming
+    size_t map_size;
+    char encoding;      // TRACE_TEXT, TRACE_FIXED, TRACE_VARINT
+    char addr_bytes;    // width of each binary address
+    addr_t last_op;     // previous op_addr (TRACE_VARINT)
+    addr_t last_data;   // previous load/store byte_addr (TRACE_VARINT)
+
+    // compressed input
+    struct zstream z;
+    char *zbuf;         // read buffer for compressed bytes, NULL when mapped
+    char *zpos;         // next compressed byte to decompress
+    char *zend;         // one past the last compressed byte
+    char zeof;          // set once fd has nothing left to give
+
+    // the traces of several cores read as one (see trace_merge), or NULL
+    struct trace_merge *merge;
+};
+
+void trace_refill(struct trace *);
+void trace_detect(struct trace *);
+void trace_merge_end(struct trace *);
+
+/*
+ * struct trace_merge: holds the traces of the cores that make up a merged trace.
+ *
+ * NOTE: the cores take turns, in order, running quantum records each, so they
+ * keep in step by the number of instructions they have run, and the merge comes
+ * out the same every time.  A core whose trace runs out drops out of the turns.
+ * Each core's trace is decoded a batch at a time into batch[c], of which used[c]
+ * records have been handed on so far.
+ */
+struct trace_merge {
+    struct trace *trace;
+    struct trace_batch *batch;
+    uint_t *used;
+    uint_t cores;
+    uint_t live;                // cores with records left
+    uint_t turn;                // the core taking its turn
+    uint_t left;                // records left in its turn
+    uint_t quantum;
+};
+
+/*
+ * trace_open: prepares the trace on fd for reading.
+ */
+void trace_open(struct trace *t, int fd)
+{
+    struct stat st;
+    int kind;
+
+    t->fd = fd;
+    t->eof = 0;
+    t->map = NULL;
+    t->map_size = 0;
+    t->z.kind = ZSTREAM_NONE;
+    t->zbuf = NULL;
+    t->merge = NULL;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        t->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (t->map != MAP_FAILED) {
+            madvise(t->map, st.st_size, MADV_SEQUENTIAL);
+            t->map_size = st.st_size;
+            t->buf = t->map;
+            t->pos = t->buf;
+            t->end = t->buf + st.st_size;
+            t->eof = 1;
+        } else {
+            t->map = NULL;
+        }
+    }
+
+    // streaming fallback (pipes, terminals, or a failed mapping)
+    if (t->map == NULL) {
+        t->buf = (char *) ec_malloc(TRACE_BUFSIZE);
+        t->pos = t->buf;
+        t->end = t->buf;
+        trace_refill(t);
+    }
+
+    // what we have so far may be compressed, in which case it becomes the input
+    // to the decompressor and we parse out of a fresh buffer instead
+    if ((kind = zstream_detect(t->pos, t->end - t->pos)) != ZSTREAM_NONE) {
+        zstream_init(&t->z, kind);
+        t->zbuf = t->map ? NULL : t->buf;
+        t->zpos = t->pos;
+        t->zend = t->end;
+        t->zeof = t->eof;
+
+        t->buf = (char *) ec_malloc(TRACE_BUFSIZE);
+        t->pos = t->buf;
+        t->end = t->buf;
+        t->eof = 0;
+        trace_refill(t);
+    }
+
+    trace_detect(t);
+}
+
+/*
+ * trace_detect: works out the encoding of the trace from its first bytes and
+ * skips past the header of a binary trace.
+ */
+void trace_detect(struct trace *t)
+{
+    struct trace_header h;
+
+    t->encoding = TRACE_TEXT;
+    t->addr_bytes = 0;
+    t->last_op = 0;
+    t->last_data = 0;
+
+    if ((size_t) (t->end - t->pos) < sizeof(h) || memcmp(t->pos, TRACE_MAGIC, sizeof(h.magic)))
+        return;
+
+    memcpy(&h, t->pos, sizeof(h));
+    if (h.version > TRACE_VERSION || (h.encoding != TRACE_FIXED && h.encoding != TRACE_VARINT)
+            || (h.addr_bytes != 4 && h.addr_bytes != 8)) {
+        fprintf(stderr, "ERROR: unsupported binary trace (version %u, encoding %u, %u byte addresses)\n",
+                h.version, h.encoding, h.addr_bytes);
+        exit(EXIT_FAILURE);
+    }
+    t->encoding = h.encoding;
+    t->addr_bytes = h.addr_bytes;
+    t->pos += sizeof(h);
+}
+
+/*
+ * trace_close: releases the mapping and buffers held by the trace.
+ */
+void trace_close(struct trace *t)
+{
+    if (t->merge != NULL) {
+        trace_merge_end(t);
+        return;
+    }
+    if (t->z.kind != ZSTREAM_NONE)
+        zstream_end(&t->z);
+    if (t->buf != t->map)
+        free(t->buf);
+    if (t->map)
+        munmap(t->map, t->map_size);
+    free(t->zbuf);
+}
+
+/*
+ * trace_merge_end: closes the traces of a merged trace.
+ */
+void trace_merge_end(struct trace *t)
+{
+    struct trace_merge *m = t->merge;
+    uint_t c;
+
+    for (c=0; c<m->cores; c++)
+        trace_close(&m->trace[c]);
+    free(m->trace);
+    free(m->batch);
+    free(m->used);
+    free(m);
+    t->merge = NULL;
+}
+
+/*
+ * trace_rewind: starts reading the trace over from the beginning, for a second
+ * pass.  Only a file can be read twice, not a pipe.
+ */
+void trace_rewind(struct trace *t)
+{
+    int fd = t->fd;
+
+    if (t->merge != NULL || lseek(fd, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "ERROR: the trace has to be read twice, so it must be a file, not a pipe\n");
+        exit(EXIT_FAILURE);
+    }
+    trace_close(t);
+    trace_open(t, fd);
+}
+
+/*
+ * trace_inflate: decompresses more of a compressed trace onto the end of buf,
+ * reading more compressed bytes from fd first if we have run out.
+ */
+void trace_inflate(struct trace *t)
+{
+    const char *in = t->zpos;
+    char *out = t->end;
+    ssize_t n;
+    int r;
+
+    if (t->zpos == t->zend && !t->zeof) {
+        n = read(t->fd, t->zbuf, TRACE_BUFSIZE);
+        if (n > 0) {
+            t->zpos = t->zbuf;
+            t->zend = t->zbuf + n;
+        } else if (n == 0) {
+            t->zeof = 1;
+        } else if (errno != EINTR) {
+            perror("read");
+            t->zeof = 1;
+        }
+        in = t->zpos;
+    }
+
+    r = zstream_run(&t->z, &in, t->zend, &t->end, t->buf + TRACE_BUFSIZE, t->zeof);
+    if (r == 0 && t->zeof && in == t->zpos && t->end == out)
+        r = -1;     // no input left and nothing came out
+    t->zpos = (char *) in;
+
+    if (r < 0)
+        fprintf(stderr, "ERROR: corrupt or truncated %s trace\n", zstream_name(t->z.kind));
+    if (r != 0)
+        t->eof = 1;
+}
+
+/*
+ * trace_refill: slides any unparsed bytes to the front of the streaming buffer
+ * and fills the rest of it from fd.
+ */
+void trace_refill(struct trace *t)
+{
+    size_t left = t->end - t->pos;
+    ssize_t n;
+
+    memmove(t->buf, t->pos, left);
+    t->pos = t->buf;
+    t->end = t->buf + left;
+
+    while (!t->eof && t->end < t->buf + TRACE_BUFSIZE) {
+        if (t->z.kind != ZSTREAM_NONE) {
+            trace_inflate(t);
+            continue;
+        }
+        n = read(t->fd, t->end, t->buf + TRACE_BUFSIZE - t->end);
+        if (n > 0)
+            t->end += n;
+        else if (n == 0)
+            t->eof = 1;
+        else if (errno != EINTR) {
+            perror("read");
+            t->eof = 1;
+        }
+    }
+}
+
+/*
+ * trace_space: returns 1 if c is whitespace as far as scanf is concerned.
+ */
+static inline int trace_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+ * trace_hex: parses a hex number at t->pos into val.
+ *
+ * returns the number of digits consumed (0 means there was no number)
+ */
+static inline int trace_hex(struct trace *t, addr_t *val)
+{
+    char *p = t->pos;
+    addr_t v = 0;
+    uint_t c;
+    int n;
+
+    while (p < t->end) {
+        c = (unsigned char) *p;
+        if (c - '0' < 10)
+            v = (v << 4) | (c - '0');
+        else if ((c | 0x20) - 'a' < 6)
+            v = (v << 4) | ((c | 0x20) - 'a' + 10);
+        else
+            break;
+        p++;
+    }
+    *val = v;
+    n = p - t->pos;
+    t->pos = p;
+    return n;
+}
+
+/*
+ * trace_next_text: parses the next "op op_addr byte_addr" line.  This accepts the
+ * same input as scanf("%c %x %x\n", ...).
+ */
+static inline int trace_next_text(struct trace *t, char *op, addr_t *op_addr, addr_t *byte_addr)
+{
+    while (t->pos < t->end && trace_space(*t->pos))
+        t->pos++;
+    if (t->pos >= t->end)
+        return 0;
+    *op = *t->pos++;
+
+    while (t->pos < t->end && trace_space(*t->pos))
+        t->pos++;
+    if (!trace_hex(t, op_addr))
+        return 0;
+
+    while (t->pos < t->end && trace_space(*t->pos))
+        t->pos++;
+    if (!trace_hex(t, byte_addr))
+        return 0;
+
+    return 1;
+}
+
+/*
+ * trace_get32: reads a little endian 32 bit value.
+ */
+static inline uint_t trace_get32(const char *p)
+{
+    const unsigned char *b = (const unsigned char *) p;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint_t) b[3] << 24);
+}
+
+/*
+ * trace_get_addr: reads a little endian address n bytes wide.
+ */
+static inline addr_t trace_get_addr(const char *p, int n)
+{
+#ifdef ADDR64
+    if (n == 8)
+        return trace_get32(p) | (addr_t) trace_get32(p + 4) << 32;
+#endif
+    return trace_get32(p);
+}
+
+/*
+ * trace_next_fixed: decodes the next fixed-width binary record.
+ */
+static inline int trace_next_fixed(struct trace *t, char *op, addr_t *op_addr, addr_t *byte_addr)
+{
+    if (t->end - t->pos < 1 + 2 * t->addr_bytes)
+        return 0;
+
+    *op = t->pos[0];
+    *op_addr = trace_get_addr(t->pos + 1, t->addr_bytes);
+    *byte_addr = trace_get_addr(t->pos + 1 + t->addr_bytes, t->addr_bytes);
+    t->pos += 1 + 2 * t->addr_bytes;
+    return 1;
+}
+
+/*
+ * trace_varint: decodes the varint at *p, leaving *p just past it.
+ *
+ * returns 1 on success, 0 if the varint runs off the end of the trace
+ */
+static inline int trace_varint(const char **p, const char *end, ulong_t *val)
+{
+    const unsigned char *b = (const unsigned char *) *p;
+    ulong_t v = 0;
+    int shift = 0;
+
+    do {
+        if ((const char *) b >= end || shift > 63)
+            return 0;
+        v |= (ulong_t) (*b & 0x7f) << shift;
+        shift += 7;
+    } while (*b++ & 0x80);
+
+    *val = v;
+    *p = (const char *) b;
+    return 1;
+}
+
+/*
+ * trace_unzigzag: maps a zigzag encoded value back to the delta it came from.
+ */
+static inline addr_t trace_unzigzag(ulong_t v)
+{
+    return (addr_t) (v >> 1) ^ -(addr_t) (v & 1);
+}
+
+/*
+ * trace_wrap: keeps an address summed from deltas to the trace's address width,
+ * as the deltas of 4 byte addresses wrap around at 32 bits.
+ */
+static inline addr_t trace_wrap(struct trace *t, addr_t addr)
+{
+#ifdef ADDR64
+    if (t->addr_bytes == 4)
+        return (uint_t) addr;
+#endif
+    return addr;
+}
+
+/*
+ * trace_next_varint: decodes the next delta encoded binary record.
+ */
+static inline int trace_next_varint(struct trace *t, char *op, addr_t *op_addr, addr_t *byte_addr)
+{
+    const char *p = t->pos;
+    ulong_t v;
+    uint_t code;
+
+    if (!trace_varint(&p, t->end, &v))
+        return 0;
+    code = v & 7;
+    if (code < sizeof(TRACE_OPS) - 1)
+        *op = TRACE_OPS[code];
+    else if (p < t->end)
+        *op = *p++;
+    else
+        return 0;
+    if (code == TRACE_OP_WIDE) {
+        if (!trace_varint(&p, t->end, &v))
+            return 0;
+    } else {
+        v >>= 3;
+    }
+    t->last_op = trace_wrap(t, t->last_op + trace_unzigzag(v));
+    *op_addr = t->last_op;
+
+    if (!trace_varint(&p, t->end, &v))
+        return 0;
+    if (*op == 'L' || *op == 'S') {
+        t->last_data = trace_wrap(t, t->last_data + trace_unzigzag(v));
+        *byte_addr = t->last_data;
+    } else {
+        *byte_addr = (addr_t) v;
+    }
+
+    t->pos = (char *) p;
+    return 1;
+}
+
+/*
+ * trace_next: reads the next record from the trace, whatever its encoding.
+ *
+ * returns 1 if a record was read, 0 at the end of the trace
+ */
+static inline int trace_next(struct trace *t, char *op, addr_t *op_addr, addr_t *byte_addr)
+{
+    if (!t->eof && t->end - t->pos < TRACE_MAXLINE)
+        trace_refill(t);
+
+    if (t->encoding == TRACE_VARINT)
+        return trace_next_varint(t, op, op_addr, byte_addr);
+    if (t->encoding == TRACE_FIXED)
+        return trace_next_fixed(t, op, op_addr, byte_addr);
+    return trace_next_text(t, op, op_addr, byte_addr);
+}
@@ -0,0 +1,223 @@
+/*
+ * zstream.h: implements a small common interface over the decompression
+ *            libraries we can read compressed traces with.  Support for each
+ *            format is compiled in with HAVE_ZLIB, HAVE_LZMA and HAVE_ZSTD.
+ *
+ * Authors: John Duhamel and Mike Travis
+ */
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// compression formats
+#define ZSTREAM_NONE    0
+#define ZSTREAM_GZIP    1
+#define ZSTREAM_XZ      2
+#define ZSTREAM_ZSTD    3
+
+/*
+ * struct zstream: holds the decompressor for one compressed stream.
+ */
+struct zstream {
+    char kind;          // one of the ZSTREAM_* formats
+    char ended;         // the last member/frame finished and nothing was started
+    void *state;        // z_stream, lzma_stream or ZSTD_DStream
+};
+
+/*
+ * zstream_name: returns a printable name for a compression format.
+ */
+const char * zstream_name(int kind)
+{
+    switch (kind) {
+        case ZSTREAM_GZIP: return "gzip";
+        case ZSTREAM_XZ:   return "xz";
+        case ZSTREAM_ZSTD: return "zstd";
+    }
+    return "uncompressed";
+}
+
+/*
+ * zstream_detect: recognizes a compressed stream by its magic bytes.
+ *
+ * returns the ZSTREAM_* format of the n bytes at p
+ */
+int zstream_detect(const char *p, size_t n)
+{
+    if (n >= 2 && !memcmp(p, "\x1f\x8b", 2))
+        return ZSTREAM_GZIP;
+    if (n >= 6 && !memcmp(p, "\xfd" "7zXZ\0", 6))
+        return ZSTREAM_XZ;
+    if (n >= 4 && !memcmp(p, "\x28\xb5\x2f\xfd", 4))
+        return ZSTREAM_ZSTD;
+    return ZSTREAM_NONE;
+}
+
+/*
+ * zstream_init: sets up a decompressor for the given format, or bails out if
+ * cachesim was built without support for it.
+ */
+void zstream_init(struct zstream *z, int kind)
+{
+    z->kind = kind;
+    z->ended = 0;
+    z->state = NULL;
+
+    switch (kind) {
+#ifdef HAVE_ZLIB
+        case ZSTREAM_GZIP:
+            z->state = ec_malloc(sizeof(z_stream));
+            if (inflateInit2((z_stream *) z->state, 15 + 32) != Z_OK) {    // +32 accepts gzip headers
+                free(z->state);
+                z->state = NULL;
+            }
+            break;
+#endif
+#ifdef HAVE_LZMA
+        case ZSTREAM_XZ: {
+            lzma_stream init = LZMA_STREAM_INIT;
+            z->state = ec_malloc(sizeof(lzma_stream));
+            *(lzma_stream *) z->state = init;
+            if (lzma_stream_decoder((lzma_stream *) z->state, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+                free(z->state);
+                z->state = NULL;
+            }
+            break;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case ZSTREAM_ZSTD:
+            z->state = ZSTD_createDStream();
+            if (z->state)
+                ZSTD_initDStream((ZSTD_DStream *) z->state);
+            break;
+#endif
+    }
+
+    if (z->state == NULL) {
+        fprintf(stderr, "ERROR: cannot decompress %s traces (cachesim was built without %s support)\n",
+                zstream_name(kind), zstream_name(kind));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * zstream_run: decompresses as much of [*in, in_end) into [*out, out_end) as will
+ * fit, advancing *in and *out past whatever was used.  final is set when no more
+ * input will ever follow.
+ *
+ * returns 1 once the stream is finished, -1 if it is corrupt or truncated, 0 otherwise
+ */
+int zstream_run(struct zstream *z, const char **in, const char *in_end,
+                char **out, char *out_end, int final)
+{
+    switch (z->kind) {
+#ifdef HAVE_ZLIB
+        case ZSTREAM_GZIP: {
+            z_stream *s = (z_stream *) z->state;
+            int ret;
+
+            for (;;) {
+                // concatenated gzip files hold several members back to back
+                if (z->ended) {
+                    if (*in == in_end)
+                        return final;
+                    inflateReset(s);
+                    z->ended = 0;
+                }
+                if (*out == out_end)
+                    return 0;
+
+                s->next_in = (Bytef *) *in;
+                s->avail_in = in_end - *in > (1 << 30) ? (1 << 30) : in_end - *in;
+                s->next_out = (Bytef *) *out;
+                s->avail_out = out_end - *out > (1 << 30) ? (1 << 30) : out_end - *out;
+                ret = inflate(s, Z_NO_FLUSH);
+                *in = (const char *) s->next_in;
+                *out = (char *) s->next_out;
+
+                if (ret == Z_STREAM_END)
+                    z->ended = 1;
+                else if (ret == Z_OK && *in < in_end)
+                    continue;
+                else if (ret == Z_OK || ret == Z_BUF_ERROR)  // out of input
+                    return *out == out_end || !final ? 0 : -1;
+                else
+                    return -1;
+            }
+        }
+#endif
+#ifdef HAVE_LZMA
+        case ZSTREAM_XZ: {
+            lzma_stream *s = (lzma_stream *) z->state;
+            lzma_ret ret;
+
+            s->next_in = (const uint8_t *) *in;
+            s->avail_in = in_end - *in;
+            s->next_out = (uint8_t *) *out;
+            s->avail_out = out_end - *out;
+            ret = lzma_code(s, final ? LZMA_FINISH : LZMA_RUN);
+            *in = (const char *) s->next_in;
+            *out = (char *) s->next_out;
+
+            if (ret == LZMA_STREAM_END)
+                return 1;
+            if (ret == LZMA_OK || (ret == LZMA_BUF_ERROR && !final))
+                return 0;
+            return -1;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case ZSTREAM_ZSTD: {
+            ZSTD_inBuffer ib = { *in, in_end - *in, 0 };
+            ZSTD_outBuffer ob = { *out, out_end - *out, 0 };
+            size_t ret;
+
+            if (z->ended && *in == in_end)
+                return final;
+            ret = ZSTD_decompressStream((ZSTD_DStream *) z->state, &ob, &ib);
+            *in += ib.pos;
+            *out += ob.pos;
+            if (ZSTD_isError(ret))
+                return -1;
+            z->ended = (ret == 0);   // a frame was completely decoded and flushed
+            return 0;
+        }
+#endif
+    }
+    return -1;
+}
+
+/*
+ * zstream_end: frees the decompressor.
+ */
+void zstream_end(struct zstream *z)
+{
+    switch (z->kind) {
+#ifdef HAVE_ZLIB
+        case ZSTREAM_GZIP:
+            inflateEnd((z_stream *) z->state);
+            free(z->state);
+            break;
+#endif
+#ifdef HAVE_LZMA
+        case ZSTREAM_XZ:
+            lzma_end((lzma_stream *) z->state);
+            free(z->state);
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case ZSTREAM_ZSTD:
+            ZSTD_freeDStream((ZSTD_DStream *) z->state);
+            break;
+#endif
+    }
+    z->kind = ZSTREAM_NONE;
+}